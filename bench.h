@@ -0,0 +1,97 @@
+/**
+ * @file bench.h
+ * @brief Timing and CSV reporting for the bench=N mode of all three programs.
+ *
+ * Header-only. A bench run renders the frame N times into memory and times
+ * each render. It then formats the last frame N times into /dev/null and
+ * times that separately, so kernel regressions are not hidden by I/O noise.
+ *
+ * One CSV line is written to stdout per bench run, with the columns
+ *
+ *   program,width,height,max_iter,threads,runs,compute_median_s,
+ *   compute_min_s,pixels_per_s,iters_per_s,output_median_s,output_min_s
+ *
+ * (bench.sh adds a view column in front and prints the header). Times are
+ * in seconds. pixels_per_s and iters_per_s use the median compute time.
+ * Iterations are counted as max_iter - value per pixel, i.e. the work of
+ * the plain escape loop, so pixels that a shortcut skips (interior, period,
+ * mariani) count as speed-up rather than as less work.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Wall clock in seconds - C23 TIME_MONOTONIC where the library has it
+static inline double bench_now(void) {
+    struct timespec ts;
+#ifdef TIME_MONOTONIC
+    timespec_get(&ts, TIME_MONOTONIC);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Opens the stream that bench runs format their output into.
+ * @return /dev/null opened for writing; exits on failure.
+ */
+static inline FILE *bench_sink(void) {
+    FILE *sink = fopen("/dev/null", "w");
+    if (!sink) {
+        perror("Failed to open /dev/null");
+        exit(EXIT_FAILURE);
+    }
+    return sink;
+}
+
+/**
+ * @brief Allocates room for the timings of runs renders.
+ * @param runs The number of timed runs.
+ * @return An array of runs doubles; exits on failure.
+ */
+static inline double *bench_alloc(int runs) {
+    double *times = malloc(sizeof(double) * runs);
+    if (!times) {
+        perror("Failed to allocate bench timings");
+        exit(EXIT_FAILURE);
+    }
+    return times;
+}
+
+static inline int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts times in place and returns the median
+static inline double bench_median(double *times, int runs) {
+    qsort(times, runs, sizeof(double), bench_cmp);
+    return runs % 2 ? times[runs / 2] : 0.5 * (times[runs / 2 - 1] + times[runs / 2]);
+}
+
+/**
+ * @brief Writes one CSV line (columns as above) to stdout.
+ * @param program The program name.
+ * @param width, height, max_iter, threads The rendered configuration.
+ * @param compute Compute times of the runs (sorted in place).
+ * @param output Output times of the runs (sorted in place).
+ * @param runs The number of runs.
+ * @param iterations Iterations of one frame, summed over its pixels.
+ */
+static inline void bench_report(const char *program, int width, int height, int max_iter, int threads,
+                                double *compute, double *output, int runs, long long iterations) {
+    double median = bench_median(compute, runs);
+    double output_median = bench_median(output, runs);
+    double pixels = (double)width * height;
+
+    printf("%s,%d,%d,%d,%d,%d,%.6f,%.6f,%.0f,%.0f,%.6f,%.6f\n",
+           program, width, height, max_iter, threads, runs, median, compute[0],
+           pixels / median, iterations / median, output_median, output[0]);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Benchmarks the three programs over a fixed set of views and sizes.
+# Prints CSV to stdout (columns in bench.h), one line per view, size and program.
+#
+# Usage: ./bench.sh [runs] [extra key=value arguments for every program]
+# e.g.   ./bench.sh 9 simd=0 > scalar.csv
+
+RUNS=${1:-5}
+[ $# -gt 0 ] && shift
+
+# name ll_x ll_y ur_x ur_y max_iter
+VIEWS="
+default -1.2 0.20 -1.0 0.35 255
+full -2.0 -1.25 0.75 1.25 255
+seahorse -0.7500 0.0950 -0.7400 0.1025 1000
+spiral -0.74545 0.11296 -0.74535 0.11304 4000
+seahorse1023 -0.7500 0.0950 -0.7400 0.1025 1023
+spiral4095 -0.74545 0.11296 -0.74535 0.11304 4095
+"
+SIZES="640x480 1920x1080"
+PROGRAMS="mandelbrot mandelbrot_complex mandelbrot_pthread"
+
+echo "view,program,width,height,max_iter,threads,runs,compute_median_s,compute_min_s,pixels_per_s,iters_per_s,output_median_s,output_min_s"
+
+echo "$VIEWS" | while read -r name ll_x ll_y ur_x ur_y max_iter; do
+    [ -z "$name" ] && continue
+    for size in $SIZES; do
+        width=${size%x*}
+        height=${size#*x}
+        for program in $PROGRAMS; do
+            "./$program" bench="$RUNS" width="$width" height="$height" \
+                ll_x="$ll_x" ll_y="$ll_y" ur_x="$ur_x" ur_y="$ur_y" max_iter="$max_iter" \
+                "$@" | sed "s/^/$name,/"
+        done
+    done
+done
@@ -0,0 +1,691 @@
+/**
+ * @file cluster.c
+ * @brief nodes= and serve=: one frame sharded over render nodes on TCP; see mandelbrot.h.
+ *
+ * The coordinator sends each node the view, then asks it for shards: runs
+ * of full rows, at most CLUSTER_INFLIGHT at a time so a node starts on the
+ * next shard while the last one is on the wire. Nodes answer with the raw
+ * values (config_pixel_bytes() each, no palette), which the coordinator
+ * colours and hands to the output writer in order. Each shard is sized
+ * from its node's measured rows per second, so faster nodes take larger
+ * shards, and shrinks towards the end of the frame so the nodes finish
+ * together. The shard of a node that fails goes to the others.
+ *
+ * Messages are unsigned 32-bit integers in network byte order:
+ *   coordinator: CLUSTER_MAGIC, job length, job ("key=value" lines for parse_arg())
+ *   node:        CLUSTER_MAGIC, pixel bytes, the number 1 in native byte order
+ *   coordinator: first image row, rows (0, 0 ends the job)
+ *   node:        first image row, rows, rows * width values in native byte order
+ */
+
+#define _POSIX_C_SOURCE 200809L // getaddrinfo() under -std=c23
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mandelbrot.h"
+#include "bench.h"
+#include "palette.h"
+
+#define CLUSTER_MAGIC         0x4d424431u  // "MBD1"
+#define CLUSTER_JOB_MAX       4096         // Longest job text a node accepts
+#define CLUSTER_INFLIGHT      2            // Shards requested from a node before its first reply
+#define CLUSTER_SHARD_SECONDS 0.5          // Time a node should spend on one shard
+#define CLUSTER_FIRST_SHARDS  16           // Shards per node the first (unmeasured) shard size gives
+#define CLUSTER_SHARD_BYTES   (64u << 20)  // Largest shard
+#define CLUSTER_WINDOW_BYTES  (256u << 20) // Rows received ahead of the writer, at most
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // A closed peer then raises SIGPIPE
+#endif
+
+static bool send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Sends two integers in network byte order
+static bool send_pair(int fd, uint32_t a, uint32_t b) {
+    uint32_t msg[2] = {htonl(a), htonl(b)};
+    return send_all(fd, msg, sizeof(msg));
+}
+
+static bool recv_pair(int fd, uint32_t *a, uint32_t *b) {
+    uint32_t msg[2];
+    if (!recv_all(fd, msg, sizeof(msg))) {
+        return false;
+    }
+    *a = ntohl(msg[0]);
+    *b = ntohl(msg[1]);
+    return true;
+}
+
+/* ---- Render node (serve=) ---- */
+
+// A TCP socket listening on port, or -1
+static int listen_on(const char *port) {
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM,
+                             .ai_flags = AI_PASSIVE};
+    struct addrinfo *list;
+    int err = getaddrinfo(NULL, port, &hints, &list);
+    if (err != 0) {
+        fprintf(stderr, "serve=%s: %s\n", port, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = list; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 8) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        perror(port);
+    }
+    freeaddrinfo(list);
+    return fd;
+}
+
+/**
+ * @brief Reads a job from the coordinator and applies it to the node's config.
+ * @param job The node's own configuration; receives the view.
+ * @return false if the coordinator did not send a valid job.
+ */
+static bool read_job(int fd, Config *job, char *text) {
+    uint32_t magic, len;
+    if (!recv_pair(fd, &magic, &len) || magic != CLUSTER_MAGIC || len >= CLUSTER_JOB_MAX ||
+        !recv_all(fd, text, len)) {
+        return false;
+    }
+    text[len] = '\0';
+    char *save;
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        parse_arg(line, job);
+    }
+    // The coordinator colours, writes and anti-aliasing does not apply to row shards
+    job->palette = PALETTE_NONE;
+    job->aa = 1;
+    job->stream = false;
+    return job->width > 0 && job->height > 0 && job->max_iter > 0;
+}
+
+// Renders the shards of one coordinator connection
+static void serve_job(RenderPool *pool, const Config *config, int fd) {
+    char text[CLUSTER_JOB_MAX];
+    Config job = *config;
+    if (!read_job(fd, &job, text)) {
+        fprintf(stderr, "Warning: serve=: dropping a connection without a valid job\n");
+        return;
+    }
+    uint32_t bytes = (uint32_t)config_pixel_bytes(&job), one = 1;
+    uint32_t hello[2] = {htonl(CLUSTER_MAGIC), htonl(bytes)};
+    if (!send_all(fd, hello, sizeof(hello)) || !send_all(fd, &one, sizeof(one))) {
+        return;
+    }
+
+    size_t stride = (size_t)job.width * bytes;
+    void *buffer = NULL;
+    size_t buffer_len = 0;
+    long long shards = 0, rows_done = 0;
+    double t0 = bench_now();
+    uint32_t y_lo, rows;
+    while (recv_pair(fd, &y_lo, &rows) && rows > 0) {
+        if (y_lo >= (uint32_t)job.height || rows > (uint32_t)job.height - y_lo ||
+            (size_t)rows * stride > CLUSTER_SHARD_BYTES) {
+            fprintf(stderr, "Warning: serve=: shard %u+%u is outside the frame\n", y_lo, rows);
+            break;
+        }
+        if ((size_t)rows * stride > buffer_len) {
+            free(buffer);
+            buffer_len = (size_t)rows * stride;
+            buffer = malloc(buffer_len);
+            if (!buffer) {
+                perror("Failed to allocate shard buffer");
+                exit(EXIT_FAILURE);
+            }
+        }
+        render_pool_region(pool, &job, (int)y_lo, (int)rows, buffer, stride, NULL);
+        if (!send_pair(fd, y_lo, rows) || !send_all(fd, buffer, (size_t)rows * stride)) {
+            break;
+        }
+        ++shards;
+        rows_done += rows;
+    }
+    free(buffer);
+    if (config->stats) {
+        fprintf(stderr, "Served %lld shards, %lld rows of %dx%d in %.3f s\n",
+                shards, rows_done, job.width, job.height, bench_now() - t0);
+    }
+}
+
+int cluster_serve(RenderPool *pool, const Config *config, const char *port) {
+    int listener = listen_on(port);
+    if (listener < 0) {
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Serving shards on port %s with %d threads\n", port,
+            render_pool_threads(pool));
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        serve_job(pool, config, fd);
+        close(fd);
+    }
+    close(listener);
+    return EXIT_FAILURE;
+}
+
+/* ---- Coordinator (nodes=) ---- */
+
+// A run of rows, numbered in output order (bottom first for format=text)
+typedef struct Shard {
+    int row;             // First output row
+    int rows;
+    void *data;          // The values, once received; image rows from the top
+    struct Shard *next;  // In the retry or the received list
+} Shard;
+
+typedef struct {
+    struct Cluster *cluster;
+    char *name;          // host:port as given
+    int fd;              // -1: not connected or failed
+    pthread_t thread;
+    bool started;        // thread is running
+    double rate;         // Measured rows per second; 0 = no reply yet
+    long long shards;
+    long long rows;
+    double busy;         // Seconds between request and reply, overlaps removed
+    double last;         // Last reply, seconds since the frame started
+} ClusterNode;
+
+typedef struct Cluster {
+    const Config *config;
+    bool bottom_up;
+    size_t stride;       // Bytes per row of values
+    int bytes;           // config_pixel_bytes()
+    ClusterNode *nodes;
+    int nnodes;
+    int alive;           // Nodes still connected
+    int total_rows;      // config->height
+    int first_rows;      // Shard size before a node has been measured
+    int max_rows;        // CLUSTER_SHARD_BYTES in rows
+    int window;          // CLUSTER_WINDOW_BYTES in rows
+    double start;
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // A shard arrived, rows were written or a node failed
+    int next_row;        // First output row not yet handed out
+    int written;         // Output rows written so far
+    long long pending;   // Rows handed out and not yet received
+    Shard *retry;        // Shards of failed nodes, to hand out again
+    Shard *received;     // Shards waiting for the writer
+} Cluster;
+
+// Connects to host:port, or returns -1 with a warning
+static int connect_node(const char *name) {
+    char host[256];
+    const char *colon = strrchr(name, ':');
+    if (!colon || colon == name || (size_t)(colon - name) >= sizeof(host)) {
+        fprintf(stderr, "Warning: nodes=: '%s' is not host:port\n", name);
+        return -1;
+    }
+    const char *h = name;
+    size_t hlen = (size_t)(colon - name);
+    if (h[0] == '[' && h[hlen - 1] == ']') {
+        ++h; // [ipv6]:port
+        hlen -= 2;
+    }
+    memcpy(host, h, hlen);
+    host[hlen] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *list;
+    int err = getaddrinfo(host, colon + 1, &hints, &list);
+    if (err != 0) {
+        fprintf(stderr, "Warning: nodes=: %s: %s\n", name, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = list; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd < 0) {
+        fprintf(stderr, "Warning: nodes=: cannot connect to %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+static const char *const algo_names[] = {[ALGO_ESCAPE] = "escape", [ALGO_MARIANI] = "mariani"};
+static const char *const engine_names[] = {
+    [ENGINE_DOUBLE] = "double", [ENGINE_PERTURB] = "perturb", [ENGINE_GPU] = "gpu"
+};
+static const char *const precision_names[] = {
+    [PRECISION_AUTO] = "auto", [PRECISION_FLOAT] = "float", [PRECISION_DOUBLE] = "double",
+    [PRECISION_LONG] = "long"
+};
+
+// Appends key=value for a coordinate: the string as given, else the double
+static int job_coordinate(char *text, size_t size, const char *key, const char *str, double v) {
+    return str ? snprintf(text, size, "%s=%s\n", key, str)
+               : snprintf(text, size, "%s=%.17g\n", key, v);
+}
+
+// The job: every option that changes the values of the frame
+static int job_text(const Config *config, char *text, size_t size) {
+    int len = snprintf(text, size,
+                       "width=%d\nheight=%d\nmax_iter=%d\nsmooth=%d\nsimd=%d\ninterior=%d\n"
+                       "period=%d\nalgo=%s\nengine=%s\nprecision=%s\n",
+                       config->width, config->height, config->max_iter, config->smooth,
+                       config->simd, config->interior, config->period, algo_names[config->algo],
+                       engine_names[config->engine], precision_names[config->precision]);
+    len += job_coordinate(text + len, size - len, "ll_x", config->ll_x_str, config->ll_x);
+    len += job_coordinate(text + len, size - len, "ll_y", config->ll_y_str, config->ll_y);
+    len += job_coordinate(text + len, size - len, "ur_x", config->ur_x_str, config->ur_x);
+    len += job_coordinate(text + len, size - len, "ur_y", config->ur_y_str, config->ur_y);
+    return len;
+}
+
+// Sends the job and checks the node's reply
+static bool start_node(Cluster *c, ClusterNode *node) {
+    char text[CLUSTER_JOB_MAX];
+    int len = job_text(c->config, text, sizeof(text));
+    if (len >= CLUSTER_JOB_MAX) {
+        fprintf(stderr, "Warning: nodes=: the view is too long to send\n");
+        return false;
+    }
+    uint32_t magic, bytes, one;
+    if (!send_pair(node->fd, CLUSTER_MAGIC, (uint32_t)len) || !send_all(node->fd, text, len) ||
+        !recv_pair(node->fd, &magic, &bytes) || !recv_all(node->fd, &one, sizeof(one)) ||
+        magic != CLUSTER_MAGIC) {
+        fprintf(stderr, "Warning: nodes=: %s did not accept the job\n", node->name);
+        return false;
+    }
+    if (bytes != (uint32_t)c->bytes || (c->bytes > 1 && one != 1)) {
+        fprintf(stderr, "Warning: nodes=: %s sends %u-byte values%s, skipping it\n", node->name,
+                bytes, one != 1 ? " in another byte order" : "");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Rows for node's next shard; the caller holds the lock.
+ *
+ * CLUSTER_SHARD_SECONDS of the node's measured rate, but at most half of
+ * its share of the remaining rows, the share being its rate over all
+ * rates (unmeasured nodes count as the mean), so every node's last shards
+ * end at about the same time.
+ */
+static int shard_rows(const Cluster *c, const ClusterNode *node) {
+    int remaining = c->total_rows - c->next_row;
+    int rows = c->first_rows;
+    if (node->rate > 0.0) {
+        double rates = 0.0;
+        int measured = 0;
+        for (int i = 0; i < c->nnodes; ++i) {
+            if (c->nodes[i].fd >= 0 && c->nodes[i].rate > 0.0) {
+                rates += c->nodes[i].rate;
+                ++measured;
+            }
+        }
+        rates += (c->alive - measured) * rates / measured;
+        double share = 0.5 * remaining * node->rate / rates;
+        double target = node->rate * CLUSTER_SHARD_SECONDS;
+        rows = (int)(share < target ? share : target);
+    }
+    int room = c->written + c->window - c->next_row;
+    rows = rows < c->max_rows ? rows : c->max_rows;
+    rows = rows < room ? rows : room;
+    rows = rows < remaining ? rows : remaining;
+    return rows > 1 ? rows : 1;
+}
+
+/**
+ * @brief The node's next shard: a failed node's first, else new rows.
+ * @param wait Block while the window is full or other nodes may still fail;
+ *        only when the node has no shard in flight.
+ * @return The shard, or NULL when there is none (yet).
+ */
+static Shard *next_shard(Cluster *c, ClusterNode *node, bool wait) {
+    Shard *shard = NULL;
+    pthread_mutex_lock(&c->lock);
+    while (true) {
+        if (c->retry) {
+            shard = c->retry;
+            c->retry = shard->next;
+            break;
+        }
+        bool rows_left = c->next_row < c->total_rows;
+        if (rows_left && c->next_row < c->written + c->window) {
+            shard = malloc(sizeof(Shard));
+            if (!shard) {
+                perror("Failed to allocate shard");
+                exit(EXIT_FAILURE);
+            }
+            *shard = (Shard){.row = c->next_row, .rows = shard_rows(c, node)};
+            c->next_row += shard->rows;
+            break;
+        }
+        // Done unless rows remain or another node's shards could come back
+        if (!wait || (!rows_left && c->pending == 0)) {
+            break;
+        }
+        pthread_cond_wait(&c->changed, &c->lock);
+    }
+    if (shard) {
+        c->pending += shard->rows;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return shard;
+}
+
+// The first image row of shard
+static int shard_y(const Cluster *c, const Shard *shard) {
+    return c->bottom_up ? c->config->height - shard->row - shard->rows : shard->row;
+}
+
+// Gives the node's shards to the other nodes and drops it
+static void fail_node(Cluster *c, ClusterNode *node, Shard **inflight, int n) {
+    fprintf(stderr, "Warning: nodes=: lost %s, moving its rows to the other nodes\n", node->name);
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < n; ++i) {
+        free(inflight[i]->data);
+        inflight[i]->data = NULL;
+        inflight[i]->next = c->retry;
+        c->retry = inflight[i];
+        c->pending -= inflight[i]->rows;
+    }
+    close(node->fd);
+    node->fd = -1;
+    --c->alive;
+    pthread_cond_broadcast(&c->changed);
+    pthread_mutex_unlock(&c->lock);
+}
+
+// One per node: keeps CLUSTER_INFLIGHT shards requested and receives them in order
+static void *node_thread(void *arg) {
+    ClusterNode *node = arg;
+    Cluster *c = node->cluster;
+    Shard *inflight[CLUSTER_INFLIGHT];
+    double sent[CLUSTER_INFLIGHT];
+    int n = 0;
+
+    while (true) {
+        while (n < CLUSTER_INFLIGHT) {
+            Shard *shard = next_shard(c, node, n == 0);
+            if (!shard) {
+                break;
+            }
+            inflight[n] = shard;
+            sent[n++] = bench_now();
+            if (!send_pair(node->fd, (uint32_t)shard_y(c, shard), (uint32_t)shard->rows)) {
+                fail_node(c, node, inflight, n);
+                return NULL;
+            }
+        }
+        if (n == 0) {
+            break;
+        }
+
+        Shard *shard = inflight[0];
+        size_t len = (size_t)shard->rows * c->stride;
+        uint32_t y_lo, rows;
+        shard->data = malloc(len);
+        if (!shard->data) {
+            perror("Failed to allocate shard");
+            exit(EXIT_FAILURE);
+        }
+        if (!recv_pair(node->fd, &y_lo, &rows) || y_lo != (uint32_t)shard_y(c, shard) ||
+            rows != (uint32_t)shard->rows || !recv_all(node->fd, shard->data, len)) {
+            fail_node(c, node, inflight, n);
+            return NULL;
+        }
+
+        // The node worked on this shard from the later of its request and the last reply
+        double now = bench_now(), since = now - c->start;
+        double from = sent[0] - c->start > node->last ? sent[0] - c->start : node->last;
+        double rate = shard->rows / (since - from > 1e-6 ? since - from : 1e-6);
+        pthread_mutex_lock(&c->lock);
+        node->rate = node->rate > 0.0 ? 0.5 * (node->rate + rate) : rate;
+        node->busy += since - from;
+        node->last = since;
+        node->shards++;
+        node->rows += shard->rows;
+        c->pending -= shard->rows;
+        shard->next = c->received;
+        c->received = shard;
+        pthread_cond_broadcast(&c->changed);
+        pthread_mutex_unlock(&c->lock);
+
+        --n;
+        memmove(inflight, inflight + 1, sizeof(*inflight) * n);
+        memmove(sent, sent + 1, sizeof(*sent) * n);
+    }
+    send_pair(node->fd, 0, 0);
+    return NULL;
+}
+
+// stats=1: one line per node and how far apart the connected ones finished
+static void print_node_stats(const Cluster *c, double wall) {
+    double last_min = wall, last_max = 0.0;
+    fprintf(stderr, "node                             shards       rows    rows/s   busy ms   last ms\n");
+    for (int i = 0; i < c->nnodes; ++i) {
+        const ClusterNode *node = &c->nodes[i];
+        fprintf(stderr, "%-30s %8lld %10lld %9.0f %9.2f %9.2f\n", node->name, node->shards,
+                node->rows, node->busy > 0.0 ? node->rows / node->busy : 0.0, node->busy * 1e3,
+                node->last * 1e3);
+        if (node->fd >= 0 && node->shards > 0) {
+            last_min = node->last < last_min ? node->last : last_min;
+            last_max = node->last > last_max ? node->last : last_max;
+        }
+    }
+    fprintf(stderr, "Cluster: %d rows on %d of %d nodes in %.2f ms, finish spread %.2f ms\n",
+            c->total_rows, c->alive, c->nnodes, wall * 1e3, (last_max - last_min) * 1e3);
+}
+
+// Writes the shards in order as they arrive, counting their values into histogram if set
+static bool write_shards(Cluster *c, OutputWriter *writer, const ColourMap *colours,
+                         Histogram *histogram) {
+    const Config *config = c->config;
+    uint8_t *rgb = colours ? malloc((size_t)3 * config->width) : NULL;
+    if (colours && !rgb) {
+        perror("Failed to allocate colour row");
+        exit(EXIT_FAILURE);
+    }
+
+    bool ok = true;
+    pthread_mutex_lock(&c->lock);
+    while (c->written < c->total_rows) {
+        Shard **link = &c->received;
+        while (*link && (*link)->row != c->written) {
+            link = &(*link)->next;
+        }
+        if (!*link) {
+            if (c->alive == 0) {
+                ok = false;
+                break;
+            }
+            pthread_cond_wait(&c->changed, &c->lock);
+            continue;
+        }
+        Shard *shard = *link;
+        *link = shard->next;
+        pthread_mutex_unlock(&c->lock);
+
+        int rows = shard->rows;
+        for (int r = 0; r < rows; ++r) {
+            int row = c->bottom_up ? rows - 1 - r : r;
+            const char *values = (const char *)shard->data + row * c->stride;
+            if (histogram) {
+                histogram_add(histogram, values, config->width, c->bytes);
+            }
+            if (colours) {
+                colour_row(colours, values, config->width, c->bytes, rgb);
+                output_row(writer, rgb);
+            } else {
+                output_row(writer, values);
+            }
+        }
+        free(shard->data);
+        free(shard);
+
+        pthread_mutex_lock(&c->lock);
+        c->written += rows;
+        pthread_cond_broadcast(&c->changed);
+    }
+    pthread_mutex_unlock(&c->lock);
+    free(rgb);
+    return ok;
+}
+
+int cluster_render(const Config *config, const char *nodes, FILE *out, Histogram *histogram) {
+    Cluster c = {
+        .config = config,
+        .bottom_up = config->format == FORMAT_TEXT,
+        .bytes = config_pixel_bytes(config),
+        .total_rows = config->height
+    };
+    c.stride = (size_t)config->width * c.bytes;
+    pthread_mutex_init(&c.lock, NULL);
+    pthread_cond_init(&c.changed, NULL);
+
+    // One ClusterNode per comma-separated host:port
+    char *list = strdup(nodes);
+    int count = 1;
+    for (const char *p = nodes; *p; ++p) {
+        count += *p == ',';
+    }
+    c.nodes = calloc(count, sizeof(ClusterNode));
+    if (!list || !c.nodes) {
+        perror("Failed to allocate nodes");
+        exit(EXIT_FAILURE);
+    }
+    char *save;
+    for (char *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        ClusterNode *node = &c.nodes[c.nnodes++];
+        *node = (ClusterNode){.cluster = &c, .name = name, .fd = connect_node(name)};
+        if (node->fd >= 0 && !start_node(&c, node)) {
+            close(node->fd);
+            node->fd = -1;
+        }
+        c.alive += node->fd >= 0;
+    }
+    if (c.alive == 0) {
+        fprintf(stderr, "nodes=%s: no render node accepted the job\n", nodes);
+        free(c.nodes);
+        free(list);
+        return EXIT_FAILURE;
+    }
+
+    size_t per_node = (size_t)c.alive * CLUSTER_FIRST_SHARDS;
+    c.max_rows = (int)(CLUSTER_SHARD_BYTES / c.stride > 0 ? CLUSTER_SHARD_BYTES / c.stride : 1);
+    c.first_rows = (int)((size_t)config->height / per_node > 0 ? (size_t)config->height / per_node : 1);
+    c.window = (int)(CLUSTER_WINDOW_BYTES / c.stride);
+    c.window = c.window > c.alive * CLUSTER_INFLIGHT ? c.window : c.alive * CLUSTER_INFLIGHT;
+
+    ColourMap *colours = config_rgb(config) ? colour_map_create(config->palette,
+                                                                config_value_max(config)) : NULL;
+    OutputWriter writer;
+    output_begin(&writer, config, out);
+    c.start = bench_now();
+    for (int i = 0; i < c.nnodes; ++i) {
+        if (c.nodes[i].fd >= 0) {
+            pthread_create(&c.nodes[i].thread, NULL, node_thread, &c.nodes[i]);
+            c.nodes[i].started = true;
+        }
+    }
+    bool ok = write_shards(&c, &writer, colours, histogram);
+    for (int i = 0; i < c.nnodes; ++i) {
+        if (c.nodes[i].started) {
+            pthread_join(c.nodes[i].thread, NULL);
+        }
+    }
+    output_end(&writer);
+    if (!ok) {
+        fprintf(stderr, "nodes=%s: every render node failed\n", nodes);
+    } else if (config->stats) {
+        print_node_stats(&c, bench_now() - c.start);
+    }
+
+    for (int i = 0; i < c.nnodes; ++i) {
+        if (c.nodes[i].fd >= 0) {
+            close(c.nodes[i].fd);
+        }
+    }
+    while (c.received) {
+        Shard *shard = c.received;
+        c.received = shard->next;
+        free(shard->data);
+        free(shard);
+    }
+    while (c.retry) {
+        Shard *shard = c.retry;
+        c.retry = shard->next;
+        free(shard);
+    }
+    colour_map_free(colours);
+    pthread_mutex_destroy(&c.lock);
+    pthread_cond_destroy(&c.changed);
+    free(c.nodes);
+    free(list);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
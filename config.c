@@ -0,0 +1,190 @@
+/**
+ * @file config.c
+ * @brief Config defaults and key=value parsing shared by the front-ends.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "mandelbrot.h"
+
+Config config_default(void) {
+    return (Config){
+        .width = 100,
+        .height = 75,
+        .format = FORMAT_ASCII,
+        .simd = true,
+        .unroll = true,
+        .interior = true,
+        .period = false,
+        .stats = false,
+        .threads = 0,
+        .pin = false,
+        .hugepages = false,
+        .chunk = 0,
+        .sched = SCHED_TILES,
+        .tile = 64,
+        .algo = ALGO_ESCAPE,
+        .engine = ENGINE_DOUBLE,
+        .precision = PRECISION_DOUBLE,
+        .stream = false,
+        .band = 0,
+        .bands = 0,
+        .ll_x = -1.2,
+        .ll_y = 0.20,
+        .ur_x = -1.0,
+        .ur_y = 0.35,
+        .ll_x_str = NULL,
+        .ll_y_str = NULL,
+        .ur_x_str = NULL,
+        .ur_y_str = NULL,
+        .max_iter = 255,
+        .bench = 0,
+        .frames = 0,
+        .zoom = 1.0,
+        .keyframes = NULL,
+        .has_end = false,
+        .ease = EASE_LINEAR,
+        .frame_out = NULL,
+        .pipeline = true,
+        .nodes = NULL,
+        .serve = NULL,
+        .progressive = false,
+        .smooth = false,
+        .aa = 1,
+        .palette = PALETTE_NONE,
+        .symbols = NULL,
+        .out_path = NULL,
+        .hist = NULL,
+        .pyramid = false,
+        .tile_dir = NULL,
+        .tile_cache = 256
+    };
+}
+
+void parse_arg(char *arg, Config *config) {
+    char *value = strchr(arg, '=');
+    if (value == NULL) {
+        fprintf(stderr, "Warning: Ignoring invalid argument '%s'\n", arg);
+        return;
+    }
+    *value = '\0'; // Temporarily split string into key and value
+    value++;       // Move pointer to the start of the value part
+
+    if (strcmp(arg, "width") == 0 || strcmp(arg, "height") == 0) {
+        // Buffers and lookup tables are sized from these: reject what cannot size them
+        int n = atoi(value);
+        if (n < 1) fprintf(stderr, "Warning: %s= wants a positive number, ignoring '%s'\n", arg, value);
+        else if (arg[0] == 'w') config->width = n;
+        else config->height = n;
+    }
+    else if (strcmp(arg, "png") == 0) config->format = atoi(value) ? FORMAT_TEXT : FORMAT_ASCII;
+    else if (strcmp(arg, "format") == 0) {
+        if (!parse_format(value, &config->format)) {
+            fprintf(stderr, "Warning: Unknown format '%s'\n", value);
+        }
+    }
+    else if (strcmp(arg, "simd") == 0) config->simd = (bool)atoi(value);
+    else if (strcmp(arg, "unroll") == 0) config->unroll = (bool)atoi(value);
+    else if (strcmp(arg, "interior") == 0) config->interior = (bool)atoi(value);
+    else if (strcmp(arg, "period") == 0) config->period = (bool)atoi(value);
+    else if (strcmp(arg, "stats") == 0) config->stats = (bool)atoi(value);
+    else if (strcmp(arg, "threads") == 0) config->threads = atoi(value);
+    else if (strcmp(arg, "pin") == 0) config->pin = (bool)atoi(value);
+    else if (strcmp(arg, "hugepages") == 0) config->hugepages = (bool)atoi(value);
+    else if (strcmp(arg, "chunk") == 0) config->chunk = atoi(value);
+    else if (strcmp(arg, "tile") == 0) config->tile = atoi(value);
+    else if (strcmp(arg, "stream") == 0) config->stream = (bool)atoi(value);
+    else if (strcmp(arg, "band") == 0) config->band = atoi(value);
+    else if (strcmp(arg, "bands") == 0) config->bands = atoi(value);
+    else if (strcmp(arg, "sched") == 0) {
+        if (strcmp(value, "rows") == 0) config->sched = SCHED_ROWS;
+        else if (strcmp(value, "tiles") == 0) config->sched = SCHED_TILES;
+        else fprintf(stderr, "Warning: Unknown scheduler '%s'\n", value);
+    }
+    else if (strcmp(arg, "algo") == 0) {
+        if (strcmp(value, "escape") == 0) config->algo = ALGO_ESCAPE;
+        else if (strcmp(value, "mariani") == 0) config->algo = ALGO_MARIANI;
+        else fprintf(stderr, "Warning: Unknown algorithm '%s'\n", value);
+    }
+    else if (strcmp(arg, "engine") == 0) {
+        if (strcmp(value, "double") == 0) config->engine = ENGINE_DOUBLE;
+        else if (strcmp(value, "perturb") == 0) config->engine = ENGINE_PERTURB;
+        else if (strcmp(value, "gpu") == 0) config->engine = ENGINE_GPU;
+        else fprintf(stderr, "Warning: Unknown engine '%s'\n", value);
+    }
+    else if (strcmp(arg, "precision") == 0) {
+        if (strcmp(value, "auto") == 0) config->precision = PRECISION_AUTO;
+        else if (strcmp(value, "float") == 0) config->precision = PRECISION_FLOAT;
+        else if (strcmp(value, "double") == 0) config->precision = PRECISION_DOUBLE;
+        else if (strcmp(value, "long") == 0) config->precision = PRECISION_LONG;
+        else fprintf(stderr, "Warning: Unknown precision '%s'\n", value);
+    }
+    else if (strcmp(arg, "ll_x") == 0) config->ll_x = atof(config->ll_x_str = value);
+    else if (strcmp(arg, "ll_y") == 0) config->ll_y = atof(config->ll_y_str = value);
+    else if (strcmp(arg, "ur_x") == 0) config->ur_x = atof(config->ur_x_str = value);
+    else if (strcmp(arg, "ur_y") == 0) config->ur_y = atof(config->ur_y_str = value);
+    else if (strcmp(arg, "max_iter") == 0) {
+        int n = atoi(value);
+        if (n < 1) fprintf(stderr, "Warning: max_iter= wants a positive number, ignoring '%s'\n", value);
+        else config->max_iter = n;
+    }
+    else if (strcmp(arg, "smooth") == 0) config->smooth = (bool)atoi(value);
+    else if (strcmp(arg, "aa") == 0) {
+        config->aa = atoi(value);
+        if (config->aa < 1 || config->aa > AA_MAX) {
+            fprintf(stderr, "Warning: aa= wants 1 to %d, using 1\n", AA_MAX);
+            config->aa = 1;
+        }
+    }
+    else if (strcmp(arg, "palette") == 0) {
+        if (strcmp(value, "none") == 0) config->palette = PALETTE_NONE;
+        else if (strcmp(value, "grey") == 0) config->palette = PALETTE_GREY;
+        else if (strcmp(value, "fire") == 0) config->palette = PALETTE_FIRE;
+        else if (strcmp(value, "ocean") == 0) config->palette = PALETTE_OCEAN;
+        else if (strcmp(value, "rainbow") == 0) config->palette = PALETTE_RAINBOW;
+        else fprintf(stderr, "Warning: Unknown palette '%s'\n", value);
+    }
+    else if (strcmp(arg, "bench") == 0) config->bench = atoi(value);
+    else if (strcmp(arg, "frames") == 0) config->frames = atoi(value);
+    else if (strcmp(arg, "zoom") == 0) config->zoom = atof(value);
+    else if (strcmp(arg, "keyframes") == 0) config->keyframes = value;
+    else if (strcmp(arg, "end") == 0) {
+        config->has_end = sscanf(value, "%lf,%lf,%lf,%lf", &config->end_ll_x, &config->end_ll_y,
+                                 &config->end_ur_x, &config->end_ur_y) == 4;
+        if (!config->has_end) fprintf(stderr, "Warning: end= wants ll_x,ll_y,ur_x,ur_y\n");
+    }
+    else if (strcmp(arg, "ease") == 0) {
+        if (strcmp(value, "linear") == 0) config->ease = EASE_LINEAR;
+        else if (strcmp(value, "in") == 0) config->ease = EASE_IN;
+        else if (strcmp(value, "out") == 0) config->ease = EASE_OUT;
+        else if (strcmp(value, "inout") == 0) config->ease = EASE_INOUT;
+        else fprintf(stderr, "Warning: Unknown easing '%s'\n", value);
+    }
+    else if (strcmp(arg, "symbols") == 0) config->symbols = value;
+    else if (strcmp(arg, "frame_out") == 0) config->frame_out = value;
+    else if (strcmp(arg, "out") == 0) config->out_path = value;
+    else if (strcmp(arg, "hist") == 0) config->hist = value;
+    else if (strcmp(arg, "pipeline") == 0) config->pipeline = (bool)atoi(value);
+    else if (strcmp(arg, "progressive") == 0) config->progressive = (bool)atoi(value);
+    else if (strcmp(arg, "nodes") == 0) config->nodes = value;
+    else if (strcmp(arg, "serve") == 0) config->serve = value;
+    else if (strcmp(arg, "pyramid") == 0) config->pyramid = (bool)atoi(value);
+    else if (strcmp(arg, "tile_dir") == 0) config->tile_dir = value;
+    else if (strcmp(arg, "tile_cache") == 0) config->tile_cache = atoi(value);
+    else if (strcmp(arg, "xyz") == 0) {
+        int z;
+        long long x, y;
+        if (sscanf(value, "%d/%lld/%lld", &z, &x, &y) == 3 && z >= 0 && z <= PYRAMID_MAX_LEVEL) {
+            pyramid_tile_view(config, z, x, y);
+            config->pyramid = true;
+        } else {
+            fprintf(stderr, "Warning: xyz= wants z/x/y with z from 0 to %d\n", PYRAMID_MAX_LEVEL);
+        }
+    }
+    else fprintf(stderr, "Warning: Unknown parameter '%s'\n", arg);
+
+    *(value - 1) = '='; // Restore the original argument string
+}
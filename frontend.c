@@ -0,0 +1,736 @@
+/**
+ * @file frontend.c
+ * @brief The command-line main() shared by mandelbrot and mandelbrot_pthread.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "mandelbrot.h"
+#include "bench.h"
+
+// render_pool_bands() consumer: writes each band's rows in output order
+static void write_band(void *ctx, int y_lo, int rows, const void *data, size_t stride) {
+    OutputWriter *writer = ctx;
+    bool bottom_up = writer->config->format == FORMAT_TEXT;
+    (void)y_lo; // bands arrive in output order
+
+    for (int r = 0; r < rows; ++r) {
+        int row = bottom_up ? rows - 1 - r : r;
+        output_row(writer, (const char *)data + row * stride);
+    }
+}
+
+// The worker pool of a run, pinned with pin=1
+static RenderPool *open_pool(const Config *config) {
+    RenderPool *pool = render_pool_create(config->threads);
+    if (config->pin && !render_pool_pin(pool)) {
+        fprintf(stderr, "Warning: pin=1: could not set the workers' CPU affinity\n");
+    }
+    return pool;
+}
+
+// A frame buffer of size bytes: first-touched by pool's workers with pin=1 or hugepages=1
+static void *alloc_frame(RenderPool *pool, const Config *config, size_t size) {
+    if (config->pin || config->hugepages) {
+        return render_pool_alloc(pool, size, config->hugepages);
+    }
+    void *buffer = malloc(size);
+    if (!buffer) {
+        perror("Failed to allocate result buffer");
+        exit(EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+static void free_frame(const Config *config, void *buffer, size_t size) {
+    if (config->pin || config->hugepages) {
+        render_pool_free(buffer, size, config->hugepages);
+    } else {
+        free(buffer);
+    }
+}
+
+// The cache of pyramid=1 runs, or NULL
+static TileCache *open_tiles(const Config *config) {
+    return config->pyramid ? tile_cache_create(config->tile_cache, config->tile_dir) : NULL;
+}
+
+/**
+ * @brief render_pool_frame(), through the tile pyramid when tiles is set.
+ * @param held The view out already holds, so a pan can reuse its pixels; NULL = none.
+ */
+static void render_view(RenderPool *pool, TileCache *tiles, const Config *held,
+                        const Config *config, void *out, size_t stride, KernelStats *stats) {
+    if (tiles) {
+        render_pyramid(tiles, pool, config, out, stride, stats);
+    } else if (held) {
+        render_pool_pan(pool, held, config, out, stride, stats);
+    } else {
+        render_pool_frame(pool, config, out, stride, stats);
+    }
+}
+
+// hist=: the zeroed histogram of the frame, for KernelStats.histogram; NULL without hist=
+static Histogram *open_histogram(const Config *config) {
+    return config->hist ? histogram_create(config_value_max(config)) : NULL;
+}
+
+// Writes the hist= file and frees the histogram; returns the exit status
+static int close_histogram(const Config *config, Histogram *histogram) {
+    if (!histogram) {
+        return EXIT_SUCCESS;
+    }
+    FILE *out = fopen(config->hist, "w");
+    if (out) {
+        write_histogram(config, histogram, out);
+    }
+    histogram_free(histogram);
+    if (!out || fclose(out) != 0) {
+        perror(config->hist);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Sums max_iter - value over the frame (see bench.h)
+static long long frame_iterations(const Config *config, const void *buffer) {
+    size_t total_pixels = (size_t)config->width * config->height;
+    int bytes = config_pixel_bytes(config);
+    if (config->smooth) {
+        // Back from fixed point to a count
+        double iterations = 0.0;
+        for (size_t i = 0; i < total_pixels; ++i) {
+            iterations += 1.0 - (double)load_iter(buffer, i, bytes) / SMOOTH_ONE;
+        }
+        return (long long)(iterations * config->max_iter);
+    }
+    long long iterations = 0;
+    for (size_t i = 0; i < total_pixels; ++i) {
+        iterations += config->max_iter - load_iter(buffer, i, bytes);
+    }
+    return iterations;
+}
+
+/**
+ * @brief bench=N: times N renders into memory, then N writes of the result.
+ *
+ * Prints one CSV line (see bench.h). stats holds the counters of the last
+ * render. The runs share one pool, so thread start-up is not timed; the
+ * engine=gpu device is set up during the first run. With pyramid=1 they
+ * share one tile cache too, so only the first run computes tiles.
+ * @param config A pointer to the configuration struct (threads resolved).
+ * @param pool The pool to render on.
+ * @param buffer The frame buffer.
+ * @param stride Bytes between rows of buffer.
+ * @param program The program name for the CSV line.
+ * @param stats Receives kernel counters.
+ */
+static void bench(const Config *config, RenderPool *pool, void *buffer, size_t stride,
+                  const char *program, KernelStats *stats) {
+    double *compute = bench_alloc(config->bench);
+    double *output = bench_alloc(config->bench);
+    FILE *sink = bench_sink();
+    TileCache *tiles = open_tiles(config);
+
+    for (int run = 0; run < config->bench; ++run) {
+        *stats = (KernelStats){0};
+        double t0 = bench_now();
+        render_view(pool, tiles, NULL, config, buffer, stride, stats);
+        compute[run] = bench_now() - t0;
+    }
+    long long iterations;
+    if (config_rgb(config)) {
+        // The timed frames hold colours; count the work on one uncoloured render
+        Config values = *config;
+        values.palette = PALETTE_NONE;
+        size_t values_stride = (size_t)config->width * config_pixel_bytes(&values);
+        void *frame = malloc(values_stride * config->height);
+        if (!frame) {
+            perror("Failed to allocate result buffer");
+            exit(EXIT_FAILURE);
+        }
+        render_view(pool, tiles, NULL, &values, frame, values_stride, &(KernelStats){0});
+        iterations = frame_iterations(&values, frame);
+        free(frame);
+    } else {
+        iterations = frame_iterations(config, buffer);
+    }
+    if (tiles) {
+        tile_cache_destroy(tiles);
+    }
+    for (int run = 0; run < config->bench; ++run) {
+        double t0 = bench_now();
+        write_frame(config, buffer, stride, sink);
+        fflush(sink);
+        output[run] = bench_now() - t0;
+    }
+
+    bench_report(program, config->width, config->height, config->max_iter, config->threads,
+                 compute, output, config->bench, iterations);
+
+    fclose(sink);
+    free(output);
+    free(compute);
+}
+
+typedef struct {
+    double ll_x, ll_y, ur_x, ur_y;
+    int max_iter;
+    const char *ll_x_str, *ll_y_str, *ur_x_str, *ur_y_str; // As given; NULL = the doubles
+    char *text; // keyframes=: owns the strings above
+} Keyframe;
+
+/**
+ * @brief Reads a keyframes= file.
+ *
+ * One view per line: "ll_x ll_y ur_x ur_y [max_iter]". Blank lines and
+ * lines starting with '#' are skipped; max_iter defaults to config's.
+ * @param config A pointer to the configuration struct.
+ * @param count Receives the number of keyframes.
+ * @return The keyframes; exits if the file cannot be read or holds none.
+ */
+static Keyframe *read_keyframes(const Config *config, int *count) {
+    FILE *in = fopen(config->keyframes, "r");
+    if (!in) {
+        perror("Failed to open keyframes");
+        exit(EXIT_FAILURE);
+    }
+
+    Keyframe *keys = NULL;
+    int n = 0, capacity = 0;
+    char line[1024];
+    for (int lineno = 1; fgets(line, sizeof(line), in); ++lineno) {
+        Keyframe k = {.max_iter = config->max_iter};
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        if (sscanf(p, "%lf %lf %lf %lf %d", &k.ll_x, &k.ll_y, &k.ur_x, &k.ur_y, &k.max_iter) < 4 ||
+            k.max_iter < 1) {
+            fprintf(stderr, "Warning: Ignoring keyframe line %d\n", lineno);
+            continue;
+        }
+        // Keep the coordinates as written, for engine=perturb and precision=long
+        k.text = malloc(strlen(p) + 1);
+        if (!k.text) {
+            perror("Failed to allocate keyframes");
+            exit(EXIT_FAILURE);
+        }
+        strcpy(k.text, p);
+        const char **str[4] = {&k.ll_x_str, &k.ll_y_str, &k.ur_x_str, &k.ur_y_str};
+        char *field = k.text;
+        for (int f = 0; f < 4; ++f) {
+            field += strspn(field, " \t");
+            *str[f] = field;
+            field += strcspn(field, " \t\r\n");
+            if (*field != '\0') {
+                *field++ = '\0';
+            }
+        }
+        if (n == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            keys = realloc(keys, sizeof(Keyframe) * capacity);
+            if (!keys) {
+                perror("Failed to allocate keyframes");
+                exit(EXIT_FAILURE);
+            }
+        }
+        keys[n++] = k;
+    }
+    fclose(in);
+
+    if (n == 0) {
+        fprintf(stderr, "Error: No keyframes in '%s'\n", config->keyframes);
+        exit(EXIT_FAILURE);
+    }
+    *count = n;
+    return keys;
+}
+
+/**
+ * @brief Sets the view of frame at position t in [0, 1] between keyframes a and b.
+ *
+ * The span changes geometrically, so the zoom speed is constant, and the
+ * centre moves in step with the span, so a pure zoom keeps its target point
+ * fixed on screen.
+ */
+static void interpolate_view(Config *frame, const Keyframe *a, const Keyframe *b, double t) {
+    double wa = a->ur_x - a->ll_x, wb = b->ur_x - b->ll_x;
+    double ha = a->ur_y - a->ll_y, hb = b->ur_y - b->ll_y;
+    double w = wa > 0 && wb > 0 ? wa * pow(wb / wa, t) : wa + (wb - wa) * t;
+    double h = ha > 0 && hb > 0 ? ha * pow(hb / ha, t) : ha + (hb - ha) * t;
+    double s = wb != wa ? (w - wa) / (wb - wa) : t;
+    double cx = 0.5 * (a->ll_x + a->ur_x) * (1 - s) + 0.5 * (b->ll_x + b->ur_x) * s;
+    double cy = 0.5 * (a->ll_y + a->ur_y) * (1 - s) + 0.5 * (b->ll_y + b->ur_y) * s;
+
+    frame->ll_x = cx - 0.5 * w;
+    frame->ur_x = cx + 0.5 * w;
+    frame->ll_y = cy - 0.5 * h;
+    frame->ur_y = cy + 0.5 * h;
+    frame->max_iter = (int)lround(a->max_iter + (b->max_iter - a->max_iter) * t);
+}
+
+// Prints the kernel reports of the options in use to stderr
+static void print_reports(const Config *config, const KernelStats *stats, size_t total_pixels) {
+    if (config->period) {
+        fprintf(stderr, "Periodicity check: %lld of %zu pixels exited early\n",
+                stats->periodic, total_pixels);
+    }
+    if (config->engine == ENGINE_PERTURB) {
+        fprintf(stderr, "Perturbation: reference orbit of %d iterations, %lld glitch rebases\n",
+                stats->orbit_len, stats->rebases);
+    }
+    if (config->algo == ALGO_MARIANI) {
+        fprintf(stderr, "Mariani-Silver: %lld of %zu pixels filled without iterating\n",
+                stats->filled, total_pixels);
+    }
+    if (config->aa > 1) {
+        fprintf(stderr, "Anti-aliasing: %lld of %zu pixels supersampled %dx%d\n",
+                stats->supersampled, total_pixels, config->aa, config->aa);
+    }
+    if (stats->reused > 0) {
+        fprintf(stderr, "Pan: %lld of %zu pixels reused from the previous frame\n",
+                stats->reused, total_pixels);
+    }
+    if (config->pyramid) {
+        fprintf(stderr, "Tile pyramid: level %d, %lld tiles from memory, %lld from disk, "
+                "%lld rendered\n", stats->tile_level, stats->tiles_memory, stats->tiles_disk,
+                stats->tiles_rendered);
+    }
+}
+
+// Maps linear progress u in [0, 1] through the ease= curve
+static double ease_progress(Easing ease, double u) {
+    switch (ease) {
+    case EASE_IN: return u * u;
+    case EASE_OUT: return u * (2.0 - u);
+    case EASE_INOUT: return u * u * (3.0 - 2.0 * u);
+    default: return u;
+    }
+}
+
+/**
+ * @brief Sets the view of frame i of nframes, spread evenly (after easing) over the keys.
+ *
+ * A frame that falls on a keyframe (the first and last always do) gets its
+ * corners and coordinate strings unchanged, so it is the image a single
+ * render of that view gives; only the frames in between are interpolated.
+ */
+static void frame_view(Config *frame, const Keyframe *keys, int nkeys, int i, int nframes) {
+    double u = ease_progress(frame->ease, nframes > 1 ? (double)i / (nframes - 1) : 0.0);
+    double pos = u * (nkeys - 1);
+    int k = (int)pos < nkeys - 1 ? (int)pos : nkeys - 1;
+    if (pos == k) {
+        const Keyframe *key = &keys[k];
+        frame->ll_x = key->ll_x;
+        frame->ll_y = key->ll_y;
+        frame->ur_x = key->ur_x;
+        frame->ur_y = key->ur_y;
+        frame->ll_x_str = key->ll_x_str;
+        frame->ll_y_str = key->ll_y_str;
+        frame->ur_x_str = key->ur_x_str;
+        frame->ur_y_str = key->ur_y_str;
+        frame->max_iter = key->max_iter;
+        return;
+    }
+    interpolate_view(frame, &keys[k], &keys[k + 1], pos - k);
+    frame->ll_x_str = frame->ll_y_str = frame->ur_x_str = frame->ur_y_str = NULL;
+}
+
+/**
+ * @brief Opens the stream frame i is written to.
+ *
+ * With frame_out set, a new file named after the pattern; otherwise stdout,
+ * with text frames after the first preceded by two blank lines (gnuplot's
+ * index separator).
+ * @return The stream; exits if the file cannot be created.
+ */
+static FILE *open_frame_output(const Config *config, int i) {
+    if (!config->frame_out) {
+        if (config->format == FORMAT_HALF || config->format == FORMAT_ANSI) {
+            // Live preview: redraw in place, clearing the screen once
+            fputs(i == 0 ? "\x1b[2J\x1b[H" : "\x1b[H", stdout);
+        } else if (i > 0 && (config->format == FORMAT_ASCII || config->format == FORMAT_TEXT)) {
+            fputs("\n\n", stdout);
+        }
+        return stdout;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), config->frame_out, i);
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return out;
+}
+
+static void close_frame_output(FILE *out) {
+    if (out != stdout && fclose(out) != 0) {
+        perror("Failed to write frame");
+        exit(EXIT_FAILURE);
+    }
+}
+
+typedef struct {
+    const Config *config;
+    int pass;     // Passes written so far
+    double start; // bench_now() when the render started
+} PassOutput;
+
+/**
+ * @brief progressive=1: writes each pass as a frame of its own, as soon as it is done.
+ *
+ * The passes go where frames=N frames go (open_frame_output()), so format=half
+ * and ansi redraw in place on the terminal. stats=1 reports the time of each pass.
+ */
+static void write_pass(void *ctx, int step, const void *frame, size_t stride) {
+    PassOutput *passes = ctx;
+    FILE *out = open_frame_output(passes->config, passes->pass++);
+    write_frame(passes->config, frame, stride, out);
+    fflush(out);
+    close_frame_output(out);
+    if (passes->config->stats) {
+        fprintf(stderr, "Progressive: 1/%d resolution written after %.2f ms\n", step,
+                (bench_now() - passes->start) * 1e3);
+    }
+}
+
+/**
+ * Two frame buffers shared by the render loop and the writer thread. The
+ * loop renders frame i into slot i % 2 once the writer has finished frame
+ * i - 2, and posts it; the writer writes posted frames in order. Encoding
+ * frame i therefore overlaps computing frame i + 1.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // a frame was posted or written
+    Config frames[2];
+    void *buffers[2];
+    size_t strides[2];
+    int nframes;
+    int posted;  // Frames handed to the writer
+    int written; // Frames the writer has finished
+} FramePipe;
+
+static void *frame_writer(void *arg) {
+    FramePipe *handoff = arg;
+
+    for (int i = 0; i < handoff->nframes; ++i) {
+        pthread_mutex_lock(&handoff->lock);
+        while (handoff->posted <= i) {
+            pthread_cond_wait(&handoff->changed, &handoff->lock);
+        }
+        pthread_mutex_unlock(&handoff->lock);
+
+        const Config *frame = &handoff->frames[i % 2];
+        FILE *out = open_frame_output(frame, i);
+        write_frame(frame, handoff->buffers[i % 2], handoff->strides[i % 2], out);
+        close_frame_output(out);
+
+        pthread_mutex_lock(&handoff->lock);
+        handoff->written = i + 1;
+        pthread_cond_signal(&handoff->changed);
+        pthread_mutex_unlock(&handoff->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief frames=N / keyframes=path / end=: renders a sequence of frames with one thread pool.
+ *
+ * Frames go back to back to stdout, where binary formats form a stream
+ * that e.g. ffmpeg -f image2pipe reads directly, or to numbered files
+ * (frame_out=). With pipeline=1 a writer thread encodes each frame while
+ * the pool computes the next; stream=1 overlaps within the frame instead.
+ * Frame buffers and the pool's workers are set up once for the whole run,
+ * and so is the pyramid=1 tile cache, so pans only compute the tiles that
+ * come into view. Without it, a frame that is the view its buffer last
+ * held moved by whole pixels only computes the strips that came into view
+ * (render_pool_pan()).
+ * Frames on a keyframe keep its coordinates as written. The frames in
+ * between are interpolated in doubles, so engine=perturb zooms are limited
+ * to double resolution between the keyframes.
+ * @param config A pointer to the configuration struct (threads resolved).
+ * @return The exit status.
+ */
+static int run_frames(const Config *config) {
+    Keyframe path[2] = {
+        {config->ll_x, config->ll_y, config->ur_x, config->ur_y, config->max_iter,
+         config->ll_x_str, config->ll_y_str, config->ur_x_str, config->ur_y_str, NULL},
+        {config->end_ll_x, config->end_ll_y, config->end_ur_x, config->end_ur_y, config->max_iter,
+         NULL, NULL, NULL, NULL, NULL}
+    };
+    Keyframe *keys = path;
+    int nkeys = 2;
+    if (config->keyframes) {
+        keys = read_keyframes(config, &nkeys);
+    } else if (!config->has_end) {
+        // Scale the span by zoom per frame about the centre of the view
+        double f = pow(config->zoom, config->frames > 1 ? config->frames - 1 : 0);
+        double cx = 0.5 * (config->ll_x + config->ur_x), cy = 0.5 * (config->ll_y + config->ur_y);
+        path[1].ll_x = cx + (config->ll_x - cx) * f;
+        path[1].ur_x = cx + (config->ur_x - cx) * f;
+        path[1].ll_y = cy + (config->ll_y - cy) * f;
+        path[1].ur_y = cy + (config->ur_y - cy) * f;
+    }
+    int nframes = config->frames > 0 ? config->frames : nkeys;
+
+    int max_iter = 0;
+    for (int k = 0; k < nkeys; ++k) {
+        max_iter = keys[k].max_iter > max_iter ? keys[k].max_iter : max_iter;
+    }
+    Config widest = *config;
+    widest.max_iter = max_iter;
+    size_t frame_bytes = (size_t)config->width * config->height * config_output_bytes(&widest);
+    int nbuffers = config->stream ? 0 : config->pipeline ? 2 : 1;
+
+    RenderPool *pool = open_pool(config);
+    FramePipe handoff = {.nframes = nframes};
+    Config held[2];           // The view each buffer holds
+    bool has_held[2] = {false, false};
+    for (int b = 0; b < nbuffers; ++b) {
+        handoff.buffers[b] = alloc_frame(pool, config, frame_bytes);
+    }
+    pthread_t writer_thread;
+    if (nbuffers == 2) {
+        pthread_mutex_init(&handoff.lock, NULL);
+        pthread_cond_init(&handoff.changed, NULL);
+        pthread_create(&writer_thread, NULL, frame_writer, &handoff);
+    }
+
+    TileCache *tiles = open_tiles(config);
+    KernelStats stats = {0};
+    double t0 = bench_now();
+    for (int i = 0; i < nframes; ++i) {
+        Config frame = *config;
+        frame_view(&frame, keys, nkeys, i, nframes);
+        size_t stride = (size_t)frame.width * config_output_bytes(&frame);
+
+        if (config->stream) {
+            FILE *out = open_frame_output(&frame, i);
+            OutputWriter writer;
+            output_begin(&writer, &frame, out);
+            render_pool_bands(pool, &frame, frame.format == FORMAT_TEXT, write_band, &writer,
+                              &stats);
+            output_end(&writer);
+            close_frame_output(out);
+        } else if (nbuffers == 1) {
+            render_view(pool, tiles, has_held[0] ? &held[0] : NULL, &frame, handoff.buffers[0],
+                        stride, &stats);
+            held[0] = frame;
+            has_held[0] = true;
+            FILE *out = open_frame_output(&frame, i);
+            write_frame(&frame, handoff.buffers[0], stride, out);
+            close_frame_output(out);
+        } else {
+            pthread_mutex_lock(&handoff.lock);
+            while (i - handoff.written >= 2) {
+                pthread_cond_wait(&handoff.changed, &handoff.lock);
+            }
+            pthread_mutex_unlock(&handoff.lock);
+
+            render_view(pool, tiles, has_held[i % 2] ? &held[i % 2] : NULL, &frame,
+                        handoff.buffers[i % 2], stride, &stats);
+            held[i % 2] = frame;
+            has_held[i % 2] = true;
+
+            pthread_mutex_lock(&handoff.lock);
+            handoff.frames[i % 2] = frame;
+            handoff.strides[i % 2] = stride;
+            handoff.posted = i + 1;
+            pthread_cond_signal(&handoff.changed);
+            pthread_mutex_unlock(&handoff.lock);
+        }
+    }
+    if (nbuffers == 2) {
+        pthread_join(writer_thread, NULL);
+        pthread_mutex_destroy(&handoff.lock);
+        pthread_cond_destroy(&handoff.changed);
+    }
+    fflush(stdout);
+    double wall = bench_now() - t0;
+
+    print_reports(config, &stats, (size_t)config->width * config->height * nframes);
+    if (config->stats) {
+        fprintf(stderr, "Frames: %d in %.3f s, %.1f frames/s on %d threads\n",
+                nframes, wall, nframes / wall, render_pool_threads(pool));
+    }
+    if (tiles) {
+        tile_cache_destroy(tiles);
+    }
+    for (int b = 0; b < nbuffers; ++b) {
+        free_frame(config, handoff.buffers[b], frame_bytes);
+    }
+    render_pool_destroy(pool);
+    if (keys != path) {
+        for (int k = 0; k < nkeys; ++k) {
+            free(keys[k].text);
+        }
+        free(keys);
+    }
+    return EXIT_SUCCESS;
+}
+
+int frontend_main(int argc, char *argv[], Config defaults, const char *program) {
+    Config config = defaults;
+
+    for (int i = 1; i < argc; ++i) {
+        parse_arg(argv[i], &config);
+    }
+
+    if (config.threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        config.threads = online > 0 ? (int)online : 1;
+    }
+    if (config.bench > 0 && (config.frames > 0 || config.keyframes || config.has_end)) {
+        fprintf(stderr, "Warning: bench times a single frame, ignoring frames/keyframes/end\n");
+        config.frames = 0;
+        config.keyframes = NULL;
+        config.has_end = false;
+    }
+    if (config.palette != PALETTE_NONE && !config_rgb(&config) && config.format != FORMAT_HALF &&
+        config.format != FORMAT_ANSI) {
+        fprintf(stderr, "Warning: palette= applies to format=png, ppm, half and ansi only\n");
+    }
+    if (config.bench > 0 && config.stream) {
+        fprintf(stderr, "Warning: bench renders whole frames, ignoring stream=1\n");
+        config.stream = false;
+    }
+    if (config.progressive && (config.bench > 0 || config.frames > 0 || config.keyframes ||
+                               config.has_end || config.pyramid)) {
+        fprintf(stderr, "Warning: progressive=1 renders single frames, ignoring it\n");
+        config.progressive = false;
+    }
+    if (config.progressive && config.out_path) {
+        fprintf(stderr, "Warning: progressive=1 writes its passes like frames, ignoring out= "
+                "(see frame_out=)\n");
+        config.out_path = NULL;
+    }
+    if (config.aa > 1 && (config.pyramid || config.progressive)) {
+        fprintf(stderr, "Warning: aa= does not apply to pyramid=1 or progressive=1\n");
+        config.aa = 1;
+    }
+    if (config.aa > 1 && config.stream) {
+        fprintf(stderr, "Warning: aa= needs whole frames, ignoring stream=1\n");
+        config.stream = false;
+    }
+    if ((config.pyramid || config.progressive) && config.stream) {
+        fprintf(stderr, "Warning: %s renders whole frames, ignoring stream=1\n",
+                config.pyramid ? "pyramid=1" : "progressive=1");
+        config.stream = false;
+    }
+    if (config.out_path && (config.bench > 0 || config.frames > 0 || config.keyframes ||
+                            config.has_end)) {
+        fprintf(stderr, "Warning: out= writes a single frame, ignoring it (see frame_out=)\n");
+        config.out_path = NULL;
+    }
+    if (config.nodes && (config.bench > 0 || config.frames > 0 || config.keyframes ||
+                         config.has_end || config.progressive || config.pyramid)) {
+        fprintf(stderr, "Warning: nodes= renders single frames, ignoring it\n");
+        config.nodes = NULL;
+    }
+    if (config.hist && (config.bench > 0 || config.frames > 0 || config.keyframes ||
+                        config.has_end || config.serve)) {
+        fprintf(stderr, "Warning: hist= counts single frames, ignoring it\n");
+        config.hist = NULL;
+    }
+    if (config.nodes && config.aa > 1) {
+        fprintf(stderr, "Warning: aa= does not apply to nodes=\n");
+        config.aa = 1;
+    }
+    if (config.serve) {
+        RenderPool *pool = open_pool(&config);
+        int status = cluster_serve(pool, &config, config.serve);
+        render_pool_destroy(pool);
+        return status;
+    }
+    if (config.frames > 0 || config.keyframes || config.has_end) {
+        return run_frames(&config);
+    }
+    if (config.nodes) {
+        // The shards are written in order as they arrive: no frame buffer here
+        FILE *out = config.out_path ? fopen(config.out_path, "wb") : stdout;
+        if (!out) {
+            perror(config.out_path);
+            return EXIT_FAILURE;
+        }
+        Histogram *histogram = open_histogram(&config);
+        int status = cluster_render(&config, config.nodes, out, histogram);
+        if (out != stdout && fclose(out) != 0) {
+            perror(config.out_path);
+            return EXIT_FAILURE;
+        }
+        if (status != EXIT_SUCCESS) {
+            histogram_free(histogram);
+            return status;
+        }
+        return close_histogram(&config, histogram);
+    }
+
+    size_t total_pixels = (size_t)config.width * config.height;
+    KernelStats stats = {.histogram = open_histogram(&config)};
+    RenderPool *pool = open_pool(&config);
+    MappedOutput mapped;
+    FILE *out = stdout;
+    if (config.out_path && !config.pyramid && config.aa <= 1 &&
+        mapped_output_open(&mapped, &config, config.out_path)) {
+        // Every worker formats its own rows straight into the file
+        render_pool_rows(pool, &config, mapped_output_rows, &mapped, &stats);
+        render_pool_destroy(pool);
+        mapped_output_close(&mapped);
+        print_reports(&config, &stats, total_pixels);
+        return close_histogram(&config, stats.histogram);
+    }
+    if (config.out_path) {
+        // No fixed row size (png, half, ansi), pyramid=1 or aa=: the usual writer, into the file
+        out = fopen(config.out_path, "wb");
+        if (!out) {
+            perror(config.out_path);
+            render_pool_destroy(pool);
+            histogram_free(stats.histogram);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.stream) {
+        OutputWriter writer;
+        output_begin(&writer, &config, out);
+        render_pool_bands(pool, &config, config.format == FORMAT_TEXT, write_band, &writer, &stats);
+        output_end(&writer);
+    } else {
+        size_t stride = (size_t)config.width * config_output_bytes(&config);
+        size_t size = stride * config.height;
+        void *result_buffer = alloc_frame(pool, &config, size);
+        if (config.bench > 0) {
+            bench(&config, pool, result_buffer, stride, program, &stats);
+        } else if (config.progressive) {
+            PassOutput passes = {.config = &config, .start = bench_now()};
+            render_pool_progressive(pool, &config, result_buffer, stride, write_pass, &passes,
+                                    &stats);
+        } else {
+            TileCache *tiles = open_tiles(&config);
+            render_view(pool, tiles, NULL, &config, result_buffer, stride, &stats);
+            if (tiles) {
+                tile_cache_destroy(tiles);
+            }
+            write_frame(&config, result_buffer, stride, out);
+        }
+        free_frame(&config, result_buffer, size);
+    }
+    render_pool_destroy(pool);
+    if (out != stdout && fclose(out) != 0) {
+        perror(config.out_path);
+        histogram_free(stats.histogram);
+        return EXIT_FAILURE;
+    }
+
+    print_reports(&config, &stats, total_pixels);
+    return close_histogram(&config, stats.histogram);
+}
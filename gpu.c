@@ -0,0 +1,363 @@
+/**
+ * @file gpu.c
+ * @brief engine=gpu: the escape-time kernel in OpenCL, loaded at runtime.
+ *
+ * Only the handful of OpenCL 1.1 entry points used here are declared, with
+ * the types and constants of the Khronos headers, and they are resolved
+ * from libOpenCL.so.1 (the ICD loader) with dlsym().
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpu.h"
+
+#define GPU_BAND_PIXELS (1 << 20) // Pixels per kernel launch; two bands are in flight
+
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint64_t cl_ulong;
+typedef cl_ulong cl_bitfield;
+typedef cl_bitfield cl_device_type;
+typedef cl_bitfield cl_mem_flags;
+typedef cl_bitfield cl_command_queue_properties;
+typedef cl_uint cl_device_info;
+typedef cl_uint cl_program_build_info;
+typedef cl_uint cl_bool;
+typedef intptr_t cl_context_properties;
+typedef struct _cl_platform_id *cl_platform_id;
+typedef struct _cl_device_id *cl_device_id;
+typedef struct _cl_context *cl_context;
+typedef struct _cl_command_queue *cl_command_queue;
+typedef struct _cl_program *cl_program;
+typedef struct _cl_kernel *cl_kernel;
+typedef struct _cl_mem *cl_mem;
+typedef struct _cl_event *cl_event;
+
+#define CL_SUCCESS                 0
+#define CL_FALSE                   0
+#define CL_DEVICE_TYPE_GPU         (1 << 2)
+#define CL_DEVICE_TYPE_ACCELERATOR (1 << 3)
+#define CL_DEVICE_NAME             0x102B
+#define CL_DEVICE_EXTENSIONS       0x1030
+#define CL_MEM_WRITE_ONLY          (1 << 1)
+#define CL_PROGRAM_BUILD_LOG       0x1183
+
+// The OpenCL entry points used, resolved by gpu_open()
+typedef struct {
+    cl_int (*GetPlatformIDs)(cl_uint, cl_platform_id *, cl_uint *);
+    cl_int (*GetDeviceIDs)(cl_platform_id, cl_device_type, cl_uint, cl_device_id *, cl_uint *);
+    cl_int (*GetDeviceInfo)(cl_device_id, cl_device_info, size_t, void *, size_t *);
+    cl_context (*CreateContext)(const cl_context_properties *, cl_uint, const cl_device_id *,
+                                void (*)(const char *, const void *, size_t, void *), void *,
+                                cl_int *);
+    cl_command_queue (*CreateCommandQueue)(cl_context, cl_device_id, cl_command_queue_properties,
+                                           cl_int *);
+    cl_program (*CreateProgramWithSource)(cl_context, cl_uint, const char **, const size_t *,
+                                          cl_int *);
+    cl_int (*BuildProgram)(cl_program, cl_uint, const cl_device_id *, const char *,
+                           void (*)(cl_program, void *), void *);
+    cl_int (*GetProgramBuildInfo)(cl_program, cl_device_id, cl_program_build_info, size_t, void *,
+                                  size_t *);
+    cl_kernel (*CreateKernel)(cl_program, const char *, cl_int *);
+    cl_mem (*CreateBuffer)(cl_context, cl_mem_flags, size_t, void *, cl_int *);
+    cl_int (*SetKernelArg)(cl_kernel, cl_uint, size_t, const void *);
+    cl_int (*EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const size_t *,
+                                   const size_t *, const size_t *, cl_uint, const cl_event *,
+                                   cl_event *);
+    cl_int (*EnqueueReadBufferRect)(cl_command_queue, cl_mem, cl_bool, const size_t *,
+                                    const size_t *, const size_t *, size_t, size_t, size_t, size_t,
+                                    void *, cl_uint, const cl_event *, cl_event *);
+    cl_int (*Finish)(cl_command_queue);
+    cl_int (*ReleaseMemObject)(cl_mem);
+    cl_int (*ReleaseKernel)(cl_kernel);
+    cl_int (*ReleaseProgram)(cl_program);
+    cl_int (*ReleaseCommandQueue)(cl_command_queue);
+    cl_int (*ReleaseContext)(cl_context);
+} OpenCL;
+
+struct GpuContext {
+    void *library;
+    OpenCL cl;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queues[2]; // Band b runs on queues[b % 2]
+    bool fp64;                  // cl_khr_fp64: double kernels available
+    cl_program programs[4][2];  // Built on first use: [pixel bytes 1/2/4, smooth][double]
+    cl_kernel kernels[4][2];
+    cl_mem buffers[2];          // Band b is computed into buffers[b % 2]
+    size_t buffer_bytes;
+};
+
+/*
+ * Same recurrence, coordinates and cardioid test as escape_row_scalar().
+ * PIXEL and REAL are set by the build options; SMOOTH stores the same
+ * fixed-point continuous value as smooth_value().
+ */
+static const char *kernel_source =
+    "#ifdef USE_DOUBLE\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "#endif\n"
+    "__kernel void escape_rows(__global PIXEL *out, int width, int height, int y0,\n"
+    "                          REAL ll_x, REAL ur_y, REAL fwidth, REAL fheight,\n"
+    "                          int max_iter, int interior) {\n"
+    "    int x = get_global_id(0), r = get_global_id(1);\n"
+    "    REAL cr = ll_x + x * fwidth / width;\n"
+    "    REAL ci = ur_y - (y0 + r) * fheight / height;\n"
+    "    int iter = 0;\n"
+    "    REAL mag = 0;\n"
+    "    REAL ci2 = ci * ci, xr = cr - (REAL)0.25, q = xr * xr + ci2, xb = cr + 1;\n"
+    "    if (interior && (q * (q + xr) <= (REAL)0.25 * ci2 || xb * xb + ci2 <= (REAL)0.0625)) {\n"
+    "        iter = max_iter;\n"
+    "    } else {\n"
+    "        REAL zr = 0, zi = 0;\n"
+    "        for (; iter < max_iter; ++iter) {\n"
+    "            REAL zr2 = zr * zr, zi2 = zi * zi;\n"
+    "            if (zr2 + zi2 > 4) { mag = zr2 + zi2; break; }\n"
+    "            zi = 2 * zr * zi + ci;\n"
+    "            zr = zr2 - zi2 + cr;\n"
+    "        }\n"
+    "    }\n"
+    "#ifdef SMOOTH\n"
+    "    float v = 0;\n"
+    "    if (iter < max_iter) {\n"
+    "        float mu = iter + 1 - log2(0.5f * log((float)mag));\n"
+    "        v = clamp((max_iter - mu) / max_iter, 0.0f, 1.0f);\n"
+    "    }\n"
+    "    out[(size_t)r * width + x] = (PIXEL)(v * SMOOTH + 0.5f);\n"
+    "#else\n"
+    "    out[(size_t)r * width + x] = (PIXEL)(max_iter - iter);\n"
+    "#endif\n"
+    "}\n";
+
+// Resolves every entry point; false if the library lacks any of them
+static bool load_opencl(void *library, OpenCL *cl) {
+#define RESOLVE(name) (*(void **)&cl->name = dlsym(library, "cl" #name)) != NULL
+    return RESOLVE(GetPlatformIDs) && RESOLVE(GetDeviceIDs) && RESOLVE(GetDeviceInfo) &&
+           RESOLVE(CreateContext) && RESOLVE(CreateCommandQueue) &&
+           RESOLVE(CreateProgramWithSource) && RESOLVE(BuildProgram) &&
+           RESOLVE(GetProgramBuildInfo) && RESOLVE(CreateKernel) && RESOLVE(CreateBuffer) &&
+           RESOLVE(SetKernelArg) && RESOLVE(EnqueueNDRangeKernel) &&
+           RESOLVE(EnqueueReadBufferRect) && RESOLVE(Finish) && RESOLVE(ReleaseMemObject) &&
+           RESOLVE(ReleaseKernel) && RESOLVE(ReleaseProgram) && RESOLVE(ReleaseCommandQueue) &&
+           RESOLVE(ReleaseContext);
+#undef RESOLVE
+}
+
+// First GPU (or accelerator) device of any platform
+static bool find_device(const OpenCL *cl, cl_device_id *device) {
+    cl_platform_id platforms[16];
+    cl_uint nplatforms = 0;
+    if (cl->GetPlatformIDs(16, platforms, &nplatforms) != CL_SUCCESS) {
+        return false;
+    }
+    for (cl_uint p = 0; p < nplatforms && p < 16; ++p) {
+        cl_uint ndevices = 0;
+        if (cl->GetDeviceIDs(platforms[p], CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_ACCELERATOR, 1,
+                             device, &ndevices) == CL_SUCCESS && ndevices > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+GpuContext *gpu_open(const char **reason) {
+    void *library = dlopen("libOpenCL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        library = dlopen("libOpenCL.so", RTLD_NOW | RTLD_LOCAL);
+    }
+    if (!library) {
+        *reason = "no OpenCL library";
+        return NULL;
+    }
+
+    GpuContext *gpu = calloc(1, sizeof(GpuContext));
+    if (!gpu) {
+        perror("Failed to allocate GPU context");
+        exit(EXIT_FAILURE);
+    }
+    gpu->library = library;
+    cl_int err = CL_SUCCESS;
+    if (!load_opencl(library, &gpu->cl)) {
+        *reason = "incomplete OpenCL library";
+    } else if (!find_device(&gpu->cl, &gpu->device)) {
+        *reason = "no OpenCL GPU device";
+    } else if (!(gpu->context = gpu->cl.CreateContext(NULL, 1, &gpu->device, NULL, NULL, &err)) ||
+               err != CL_SUCCESS) {
+        *reason = "cannot create an OpenCL context";
+    } else {
+        for (int q = 0; q < 2 && err == CL_SUCCESS; ++q) {
+            gpu->queues[q] = gpu->cl.CreateCommandQueue(gpu->context, gpu->device, 0, &err);
+        }
+        if (err != CL_SUCCESS) {
+            *reason = "cannot create an OpenCL command queue";
+        } else {
+            char extensions[4096] = "";
+            gpu->cl.GetDeviceInfo(gpu->device, CL_DEVICE_EXTENSIONS, sizeof(extensions) - 1,
+                                  extensions, NULL);
+            gpu->fp64 = strstr(extensions, "cl_khr_fp64") != NULL;
+            return gpu;
+        }
+    }
+    gpu_close(gpu);
+    return NULL;
+}
+
+void gpu_close(GpuContext *gpu) {
+    const OpenCL *cl = &gpu->cl;
+    for (int b = 0; b < 2; ++b) {
+        if (gpu->buffers[b]) cl->ReleaseMemObject(gpu->buffers[b]);
+        if (gpu->queues[b]) cl->ReleaseCommandQueue(gpu->queues[b]);
+    }
+    for (int w = 0; w < 4; ++w) {
+        for (int d = 0; d < 2; ++d) {
+            if (gpu->kernels[w][d]) cl->ReleaseKernel(gpu->kernels[w][d]);
+            if (gpu->programs[w][d]) cl->ReleaseProgram(gpu->programs[w][d]);
+        }
+    }
+    if (gpu->context) cl->ReleaseContext(gpu->context);
+    dlclose(gpu->library);
+    free(gpu);
+}
+
+// The kernel for this element width (or smooth=1) and precision, built on first use
+static cl_kernel gpu_kernel(GpuContext *gpu, int bytes, bool smooth, bool use_double,
+                            const char **reason) {
+    static const char *pixel_types[4] = {"uchar", "ushort", "uint", "ushort"};
+    int w = smooth ? 3 : bytes == 1 ? 0 : bytes == 2 ? 1 : 2;
+    if (gpu->kernels[w][use_double]) {
+        return gpu->kernels[w][use_double];
+    }
+
+    const OpenCL *cl = &gpu->cl;
+    cl_int err;
+    cl_program program = cl->CreateProgramWithSource(gpu->context, 1, &kernel_source, NULL, &err);
+    if (err != CL_SUCCESS) {
+        *reason = "cannot create the OpenCL program";
+        return NULL;
+    }
+    char options[128];
+    snprintf(options, sizeof(options), "-DPIXEL=%s -DREAL=%s%s", pixel_types[w],
+             use_double ? "double" : "float", use_double ? " -DUSE_DOUBLE" : "");
+    if (smooth) {
+        snprintf(options + strlen(options), sizeof(options) - strlen(options), " -DSMOOTH=%d",
+                 SMOOTH_ONE);
+    }
+    if (cl->BuildProgram(program, 1, &gpu->device, options, NULL, NULL) != CL_SUCCESS) {
+        char log[4096] = "";
+        cl->GetProgramBuildInfo(program, gpu->device, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log,
+                                NULL);
+        fprintf(stderr, "%s", log);
+        cl->ReleaseProgram(program);
+        *reason = "the OpenCL kernel failed to build";
+        return NULL;
+    }
+    cl_kernel kernel = cl->CreateKernel(program, "escape_rows", &err);
+    if (err != CL_SUCCESS) {
+        cl->ReleaseProgram(program);
+        *reason = "cannot create the OpenCL kernel";
+        return NULL;
+    }
+    gpu->programs[w][use_double] = program;
+    gpu->kernels[w][use_double] = kernel;
+    return kernel;
+}
+
+// Grows the two band buffers to bytes each
+static bool gpu_reserve(GpuContext *gpu, size_t bytes) {
+    if (bytes <= gpu->buffer_bytes) {
+        return true;
+    }
+    for (int b = 0; b < 2; ++b) {
+        if (gpu->buffers[b]) {
+            gpu->cl.ReleaseMemObject(gpu->buffers[b]);
+        }
+        cl_int err;
+        gpu->buffers[b] = gpu->cl.CreateBuffer(gpu->context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+        if (err != CL_SUCCESS) {
+            gpu->buffers[b] = NULL;
+            gpu->buffer_bytes = 0;
+            return false;
+        }
+    }
+    gpu->buffer_bytes = bytes;
+    return true;
+}
+
+// Sets a REAL kernel argument from a double
+static cl_int set_real_arg(const OpenCL *cl, cl_kernel kernel, cl_uint index, double value,
+                           bool use_double) {
+    float single = (float)value;
+    return use_double ? cl->SetKernelArg(kernel, index, sizeof(double), &value)
+                      : cl->SetKernelArg(kernel, index, sizeof(float), &single);
+}
+
+bool gpu_render_rows(GpuContext *gpu, const Config *config, int y_lo, int rows, void *out,
+                     size_t stride, const char **reason) {
+    const OpenCL *cl = &gpu->cl;
+    bool use_double = config->precision != PRECISION_FLOAT;
+    if (use_double && !gpu->fp64) {
+        *reason = "the device has no double precision";
+        return false;
+    }
+    cl_kernel kernel = gpu_kernel(gpu, config->pixel_bytes, config->smooth, use_double, reason);
+    if (!kernel) {
+        return false;
+    }
+    int width = config->width;
+    int band_rows = GPU_BAND_PIXELS / width > 0 ? GPU_BAND_PIXELS / width : 1;
+    size_t row_bytes = (size_t)width * config->pixel_bytes;
+    if (!gpu_reserve(gpu, row_bytes * band_rows)) {
+        *reason = "cannot allocate device memory";
+        return false;
+    }
+
+    int height = config->height, max_iter = config->max_iter, interior = config->interior;
+    cl_int err = CL_SUCCESS;
+    err |= cl->SetKernelArg(kernel, 1, sizeof(int), &width);
+    err |= cl->SetKernelArg(kernel, 2, sizeof(int), &height);
+    err |= set_real_arg(cl, kernel, 4, config->ll_x, use_double);
+    err |= set_real_arg(cl, kernel, 5, config->ur_y, use_double);
+    err |= set_real_arg(cl, kernel, 6, config->ur_x - config->ll_x, use_double);
+    err |= set_real_arg(cl, kernel, 7, config->ur_y - config->ll_y, use_double);
+    err |= cl->SetKernelArg(kernel, 8, sizeof(int), &max_iter);
+    err |= cl->SetKernelArg(kernel, 9, sizeof(int), &interior);
+
+    /*
+     * In-order queues: the read of band b - 2 precedes the kernel of band b
+     * on the same queue and buffer, while the other queue's kernel runs
+     * alongside it. Arguments are captured at enqueue time.
+     */
+    for (int r0 = 0, b = 0; r0 < rows && err == CL_SUCCESS; r0 += band_rows, ++b) {
+        int n = rows - r0 < band_rows ? rows - r0 : band_rows;
+        int y0 = y_lo + r0;
+        size_t global[2] = {(size_t)width, (size_t)n};
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {row_bytes, (size_t)n, 1};
+
+        err |= cl->SetKernelArg(kernel, 0, sizeof(cl_mem), &gpu->buffers[b % 2]);
+        err |= cl->SetKernelArg(kernel, 3, sizeof(int), &y0);
+        if (err == CL_SUCCESS) {
+            err = cl->EnqueueNDRangeKernel(gpu->queues[b % 2], kernel, 2, NULL, global, NULL, 0,
+                                           NULL, NULL);
+        }
+        if (err == CL_SUCCESS) {
+            err = cl->EnqueueReadBufferRect(gpu->queues[b % 2], gpu->buffers[b % 2], CL_FALSE,
+                                            origin, origin, region, row_bytes, 0, stride, 0,
+                                            (char *)out + (size_t)r0 * stride, 0, NULL, NULL);
+        }
+    }
+    // Wait for both queues even after an error: reads may still target out
+    for (int q = 0; q < 2; ++q) {
+        err |= cl->Finish(gpu->queues[q]);
+    }
+    if (err != CL_SUCCESS) {
+        *reason = "an OpenCL call failed";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file gpu.h
+ * @brief OpenCL backend of engine=gpu, internal to libmandelbrot.
+ *
+ * The OpenCL library is loaded with dlopen() when the first GPU frame is
+ * rendered, so neither the headers nor libOpenCL are needed to build, and
+ * a machine without a device renders on the CPU instead (see render.c).
+ */
+
+#ifndef GPU_H
+#define GPU_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mandelbrot.h"
+
+typedef struct GpuContext GpuContext;
+
+/**
+ * @brief Loads OpenCL and opens the first GPU or accelerator device.
+ * @param reason Receives why no device could be used.
+ * @return The context, or NULL.
+ */
+GpuContext *gpu_open(const char **reason);
+
+void gpu_close(GpuContext *gpu);
+
+/**
+ * @brief Renders rows [y_lo, y_lo + rows) of the frame into out.
+ *
+ * The rows are computed in bands on two command queues, so reading band
+ * b back overlaps the kernel of band b + 1. Same values and layout as the
+ * CPU kernels; period and algo are not used.
+ * @param gpu The context.
+ * @param config A pointer to the configuration struct (pixel_bytes and
+ *        precision resolved; PRECISION_LONG runs in double).
+ * @param y_lo The first image row.
+ * @param rows The number of rows.
+ * @param out rows rows of width values, config->pixel_bytes each.
+ * @param stride Bytes from one row of out to the next.
+ * @param reason Receives the failure, if any.
+ * @return false if the device failed or lacks double support for the
+ *         precision; out is then incomplete.
+ */
+bool gpu_render_rows(GpuContext *gpu, const Config *config, int y_lo, int rows, void *out,
+                     size_t stride, const char **reason);
+
+#endif // GPU_H
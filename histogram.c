@@ -0,0 +1,188 @@
+/**
+ * @file histogram.c
+ * @brief hist= value histograms and the hist= file; see histogram.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+#define HISTOGRAM_SLOTS 64 // Initial map size; it doubles at half full
+
+Histogram *histogram_create(int value_max) {
+    Histogram *h = calloc(1, sizeof(Histogram));
+    if (!h) {
+        perror("Failed to allocate histogram");
+        exit(EXIT_FAILURE);
+    }
+    h->value_max = -1;
+    histogram_reset(h, value_max);
+    return h;
+}
+
+void histogram_free(Histogram *h) {
+    if (h) {
+        free(h->dense);
+        free(h->slots);
+        free(h);
+    }
+}
+
+void histogram_reset(Histogram *h, int value_max) {
+    value_max = value_max > 0 ? value_max : 0;
+    int dense_lo = value_max >= HISTOGRAM_DENSE ? value_max - (HISTOGRAM_DENSE - 1) : 0;
+    if (!h->dense || value_max - dense_lo != h->value_max - h->dense_lo) {
+        free(h->dense);
+        h->dense = malloc(sizeof(long long) * (size_t)(value_max - dense_lo + 1));
+        if (!h->dense) {
+            perror("Failed to allocate histogram");
+            exit(EXIT_FAILURE);
+        }
+    }
+    h->value_max = value_max;
+    h->dense_lo = dense_lo;
+    memset(h->dense, 0, sizeof(long long) * (size_t)(value_max - dense_lo + 1));
+    if (h->used > 0) {
+        memset(h->slots, 0, sizeof(HistogramSlot) * h->nslots);
+        h->used = 0;
+    }
+}
+
+static inline size_t slot_hash(int value, size_t nslots) {
+    return (size_t)((uint32_t)value * 0x9e3779b1u) & (nslots - 1);
+}
+
+// Adds count to value in the map, growing it at half full
+static void map_add(Histogram *h, int value, long long count) {
+    if (2 * (h->used + 1) > h->nslots) {
+        size_t nslots = h->nslots ? 2 * h->nslots : HISTOGRAM_SLOTS;
+        HistogramSlot *slots = calloc(nslots, sizeof(HistogramSlot));
+        if (!slots) {
+            perror("Failed to allocate histogram");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < h->nslots; ++i) {
+            if (h->slots[i].count > 0) {
+                size_t j = slot_hash(h->slots[i].value, nslots);
+                while (slots[j].count > 0) {
+                    j = (j + 1) & (nslots - 1);
+                }
+                slots[j] = h->slots[i];
+            }
+        }
+        free(h->slots);
+        h->slots = slots;
+        h->nslots = nslots;
+    }
+
+    size_t j = slot_hash(value, h->nslots);
+    while (h->slots[j].count > 0 && h->slots[j].value != value) {
+        j = (j + 1) & (h->nslots - 1);
+    }
+    if (h->slots[j].count == 0) {
+        h->slots[j].value = value;
+        h->used++;
+    }
+    h->slots[j].count += count;
+}
+
+// The counting loop, inlined once per element width
+static inline __attribute__((always_inline))
+void count_values(Histogram *h, const void *values, int n, int bytes) {
+    int lo = h->dense_lo;
+    for (int i = 0; i < n; ++i) {
+        int v = load_iter(values, i, bytes);
+        if (v >= lo) {
+            h->dense[v - lo]++;
+        } else {
+            map_add(h, v, 1);
+        }
+    }
+}
+
+void histogram_add(Histogram *h, const void *values, int n, int bytes) {
+    switch (bytes) {
+    case 1: count_values(h, values, n, 1); break;
+    case 2: count_values(h, values, n, 2); break;
+    default: count_values(h, values, n, 4); break;
+    }
+}
+
+void histogram_merge(Histogram *dst, const Histogram *src) {
+    for (int v = 0; v <= src->value_max - src->dense_lo; ++v) {
+        dst->dense[v] += src->dense[v];
+    }
+    for (size_t i = 0; src->used > 0 && i < src->nslots; ++i) {
+        if (src->slots[i].count > 0) {
+            map_add(dst, src->slots[i].value, src->slots[i].count);
+        }
+    }
+}
+
+static int slot_cmp(const void *a, const void *b) {
+    int x = ((const HistogramSlot *)a)->value, y = ((const HistogramSlot *)b)->value;
+    return (x > y) - (x < y);
+}
+
+// The escape iteration of a value other than 0 (max_iter - value, or back from smooth fixed point)
+static double escape_iterations(const Config *config, int value) {
+    return config->smooth ? config->max_iter * (1.0 - (double)value / SMOOTH_ONE)
+                          : config->max_iter - value;
+}
+
+void write_histogram(const Config *config, const Histogram *h, FILE *out) {
+    // All counts in increasing value order: the map's values sorted, then the table
+    size_t nbins = h->used + (size_t)(h->value_max - h->dense_lo + 1);
+    HistogramSlot *bins = malloc(sizeof(HistogramSlot) * nbins);
+    if (!bins) {
+        perror("Failed to allocate histogram");
+        exit(EXIT_FAILURE);
+    }
+    size_t n = 0;
+    for (size_t i = 0; h->used > 0 && i < h->nslots; ++i) {
+        if (h->slots[i].count > 0) {
+            bins[n++] = h->slots[i];
+        }
+    }
+    qsort(bins, n, sizeof(HistogramSlot), slot_cmp);
+    for (int v = h->dense_lo; v <= h->value_max; ++v) {
+        if (h->dense[v - h->dense_lo] > 0) {
+            bins[n++] = (HistogramSlot){v, h->dense[v - h->dense_lo]};
+        }
+    }
+
+    long long pixels = 0, escaped = 0, interior = 0;
+    double sum = 0.0, lo = 0.0, hi = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        pixels += bins[i].count;
+        if (bins[i].value == 0) {
+            interior = bins[i].count;
+            continue;
+        }
+        double e = escape_iterations(config, bins[i].value);
+        // Larger values escape sooner: the first one seen is the latest escape
+        hi = escaped == 0 ? e : hi;
+        lo = e;
+        escaped += bins[i].count;
+        sum += e * bins[i].count;
+    }
+
+    fprintf(out, "# width %d height %d max_iter %d smooth %d value_max %d\n", config->width,
+            config->height, config->max_iter, config->smooth, h->value_max);
+    fprintf(out, "# pixels %lld\n", pixels);
+    fprintf(out, "# interior %lld %.6f\n", interior, pixels > 0 ? (double)interior / pixels : 0.0);
+    if (escaped > 0) {
+        fprintf(out, "# escape min %.6g max %.6g mean %.6g\n", lo, hi, sum / escaped);
+    } else {
+        fprintf(out, "# escape none\n");
+    }
+    fprintf(out, "# value count\n");
+    for (size_t i = 0; i < n; ++i) {
+        fprintf(out, "%d %lld\n", bins[i].value, bins[i].count);
+    }
+    free(bins);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file histogram.h
+ * @brief hist= value histograms, internal to libmandelbrot.
+ *
+ * A Histogram counts the values [0, value_max] of a render buffer without
+ * a slot per possible value, so max_iter can be any int. The
+ * HISTOGRAM_DENSE values nearest value_max (the points that escape within
+ * that many iterations; every value up to max_iter 65535 or with smooth=1)
+ * are counted in a table. The rarer smaller values, each of which cost
+ * more than HISTOGRAM_DENSE iterations or lies in the set, go to an
+ * open-addressing map that grows with the values actually seen. Render
+ * workers count into one Histogram each, merged after the join (see
+ * render.c).
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+
+#include "mandelbrot.h"
+
+#define HISTOGRAM_DENSE 65536 // Values counted in the table; the rest go to the map
+
+typedef struct {
+    int value;
+    long long count; // 0 = empty slot
+} HistogramSlot;
+
+struct Histogram {
+    int value_max;
+    int dense_lo;          // The table counts the values [dense_lo, value_max]
+    long long *dense;      // value_max - dense_lo + 1 counts, by value - dense_lo
+    HistogramSlot *slots;  // The values below dense_lo; nslots is 0 or a power of two
+    size_t nslots;
+    size_t used;           // Occupied slots
+};
+
+// Empties h and sets its range to [0, value_max], reusing its memory
+void histogram_reset(Histogram *h, int value_max);
+
+// Adds the counts of src to dst (same value_max)
+void histogram_merge(Histogram *dst, const Histogram *src);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,358 @@
+/**
+ * @file image_output.c
+ * @brief Binary image writers (PGM, raw 16-bit, PNG); see image_output.h.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image_output.h"
+
+#define IDAT_CHUNK (1 << 16) // Compressed bytes collected before an IDAT chunk is written
+
+bool parse_format(const char *name, OutputFormat *format) {
+    if (strcmp(name, "ascii") == 0) *format = FORMAT_ASCII;
+    else if (strcmp(name, "text") == 0) *format = FORMAT_TEXT;
+    else if (strcmp(name, "pgm") == 0) *format = FORMAT_PGM;
+    else if (strcmp(name, "raw16") == 0) *format = FORMAT_RAW16;
+    else if (strcmp(name, "png") == 0) *format = FORMAT_PNG;
+    else if (strcmp(name, "ppm") == 0) *format = FORMAT_PPM;
+    else if (strcmp(name, "half") == 0) *format = FORMAT_HALF;
+    else if (strcmp(name, "ansi") == 0) *format = FORMAT_ANSI;
+    else return false;
+    return true;
+}
+
+static uint32_t png_crc_table[256];
+static pthread_once_t png_crc_once = PTHREAD_ONCE_INIT;
+
+static void png_crc_init(void) {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        png_crc_table[n] = c;
+    }
+}
+
+static inline uint32_t png_crc(uint32_t crc, const uint8_t *data, size_t len) {
+    pthread_once(&png_crc_once, png_crc_init); // writers may run on several threads
+    for (size_t i = 0; i < len; ++i) {
+        crc = png_crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static void png_chunk(FILE *out, const char *type, const uint8_t *data, size_t len) {
+    uint8_t head[8];
+    put_be32(head, (uint32_t)len);
+    memcpy(head + 4, type, 4);
+    uint32_t crc = png_crc(0xffffffffu, head + 4, 4);
+    crc = png_crc(crc, data, len) ^ 0xffffffffu;
+
+    uint8_t tail[4];
+    put_be32(tail, crc);
+    fwrite(head, 1, 8, out);
+    if (len > 0) {
+        fwrite(data, 1, len, out);
+    }
+    fwrite(tail, 1, 4, out);
+}
+
+// Appends n bits (LSB first) to the deflate stream, flushing whole bytes to zbuf
+static inline void deflate_bits(ImageWriter *w, uint32_t value, int n) {
+    w->bits |= (uint64_t)value << w->nbits;
+    w->nbits += n;
+    while (w->nbits >= 8) {
+        w->zbuf[w->zlen++] = (uint8_t)w->bits;
+        w->bits >>= 8;
+        w->nbits -= 8;
+    }
+}
+
+// Huffman codes are defined MSB first; deflate packs them reversed
+static inline void deflate_code(ImageWriter *w, uint32_t code, int n) {
+    uint32_t rev = 0;
+    for (int i = 0; i < n; ++i) {
+        rev = rev << 1 | ((code >> i) & 1);
+    }
+    deflate_bits(w, rev, n);
+}
+
+// Fixed Huffman literal/length alphabet (RFC 1951, 3.2.6)
+static inline void deflate_symbol(ImageWriter *w, int sym) {
+    if (sym < 144) deflate_code(w, 0x30 + sym, 8);
+    else if (sym < 256) deflate_code(w, 0x190 + sym - 144, 9);
+    else if (sym < 280) deflate_code(w, sym - 256, 7);
+    else deflate_code(w, 0xc0 + sym - 280, 8);
+}
+
+static void deflate_match(ImageWriter *w, int len, int dist) {
+    static const uint16_t len_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const uint8_t len_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const uint16_t dist_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static const uint8_t dist_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    int lc = 28;
+    while (len_base[lc] > len) --lc;
+    deflate_symbol(w, 257 + lc);
+    deflate_bits(w, len - len_base[lc], len_extra[lc]);
+
+    int dc = 29;
+    while (dist_base[dc] > dist) --dc;
+    deflate_code(w, dc, 5);
+    deflate_bits(w, dist - dist_base[dc], dist_extra[dc]);
+}
+
+static void png_flush_idat(ImageWriter *w) {
+    if (w->zlen > 0) {
+        png_chunk(w->out, "IDAT", w->zbuf, w->zlen);
+        w->zlen = 0;
+    }
+}
+
+// Compresses one scanline (filter type 0) into the deflate stream
+static void png_deflate_row(ImageWriter *w) {
+    const uint8_t *cur = w->scanline;
+    bool above = w->rows_written > 0 && w->stride <= 32768;
+    size_t n = w->stride;
+    size_t pixel = w->rgb ? 3 : 1; // Runs repeat the previous pixel
+
+    for (size_t i = 0; i < n; ++i) {
+        w->adler_a = (w->adler_a + cur[i]) % 65521;
+        w->adler_b = (w->adler_b + w->adler_a) % 65521;
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        size_t max = n - i < 258 ? n - i : 258;
+        size_t run = 0, up = 0;
+        if (i >= pixel) {
+            while (run < max && cur[i + run] == cur[i + run - pixel]) ++run;
+        }
+        if (above) {
+            while (up < max && cur[i + up] == w->previous[i + up]) ++up;
+        }
+
+        if (run >= 3 && run >= up) {
+            deflate_match(w, (int)run, (int)pixel);
+            i += run;
+        } else if (up >= 3) {
+            deflate_match(w, (int)up, (int)n);
+            i += up;
+        } else {
+            deflate_symbol(w, cur[i]);
+            ++i;
+        }
+
+        // Worst case per symbol is well under 8 bytes
+        if (w->zlen > IDAT_CHUNK) {
+            png_flush_idat(w);
+        }
+    }
+}
+
+// The fields shared by image_begin*() and image_layout(); no buffers yet
+static void image_init(ImageWriter *w, FILE *out, OutputFormat format, int width, int height,
+                       int max_iter, bool rgb) {
+    *w = (ImageWriter){
+        .out = out,
+        .format = format,
+        .width = width,
+        .height = height,
+        .max_iter = max_iter,
+        .depth = format == FORMAT_RAW16 || max_iter > 255 ? 2 : 1,
+        .rgb = rgb,
+        .adler_a = 1
+    };
+
+    int channels = rgb || format == FORMAT_PPM ? 3 : 1;
+    w->stride = 1 + (size_t)width * channels * w->depth;
+}
+
+// Writes the PGM/PPM header into buf (at least IMAGE_HEADER_MAX bytes); returns its length
+static size_t image_header(const ImageWriter *w, char *buf) {
+    if (w->format != FORMAT_PGM && w->format != FORMAT_PPM) {
+        return 0;
+    }
+    return (size_t)snprintf(buf, IMAGE_HEADER_MAX, "%s\n%d %d\n%d\n",
+                            w->format == FORMAT_PGM ? "P5" : "P6", w->width, w->height,
+                            w->max_iter > IMAGE_MAXVAL ? IMAGE_MAXVAL :
+                            w->max_iter > 0 ? w->max_iter : 1);
+}
+
+size_t image_layout(ImageWriter *w, OutputFormat format, int width, int height, int max_iter,
+                    bool rgb, char *header) {
+    image_init(w, NULL, format, width, height, rgb ? 255 : max_iter, rgb);
+    return image_header(w, header);
+}
+
+static void image_begin_common(ImageWriter *w, FILE *out, OutputFormat format, int width,
+                               int height, int max_iter, bool rgb) {
+    image_init(w, out, format, width, height, max_iter, rgb);
+    w->scanline = malloc(w->stride);
+    if (!w->scanline) {
+        perror("Failed to allocate image row");
+        exit(EXIT_FAILURE);
+    }
+
+    if (format == FORMAT_PGM || format == FORMAT_PPM) {
+        char header[IMAGE_HEADER_MAX];
+        fwrite(header, 1, image_header(w, header), out);
+    } else if (format == FORMAT_PNG) {
+        w->previous = malloc(w->stride);
+        w->zbuf = malloc(IDAT_CHUNK + 64);
+        if (!w->previous || !w->zbuf) {
+            perror("Failed to allocate PNG buffers");
+            exit(EXIT_FAILURE);
+        }
+
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        fwrite(signature, 1, sizeof(signature), out);
+
+        uint8_t ihdr[13];
+        put_be32(ihdr, (uint32_t)width);
+        put_be32(ihdr + 4, (uint32_t)height);
+        ihdr[8] = (uint8_t)(8 * w->depth); // bit depth
+        ihdr[9] = rgb ? 2 : 0;             // truecolour or greyscale
+        ihdr[10] = ihdr[11] = ihdr[12] = 0; // deflate, adaptive filters, no interlace
+        png_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+        w->zbuf[w->zlen++] = 0x78; // zlib header: deflate, 32K window
+        w->zbuf[w->zlen++] = 0x01;
+        deflate_bits(w, 1, 1);     // BFINAL: the whole image is one block
+        deflate_bits(w, 1, 2);     // BTYPE 01: fixed Huffman codes
+    }
+}
+
+void image_begin(ImageWriter *w, FILE *out, OutputFormat format, int width, int height,
+                 int max_iter) {
+    image_begin_common(w, out, format, width, height, max_iter, false);
+}
+
+void image_begin_rgb(ImageWriter *w, FILE *out, OutputFormat format, int width, int height) {
+    image_begin_common(w, out, format, width, height, 255, true);
+}
+
+// Reads element i of a row of bytes-wide unsigned values (1, 2 or 4; 4 is int)
+static inline __attribute__((always_inline))
+uint32_t image_sample(const void *row, int i, int bytes) {
+    if (bytes == 1) return ((const uint8_t *)row)[i];
+    if (bytes == 2) return ((const uint16_t *)row)[i];
+    return (uint32_t)((const int *)row)[i];
+}
+
+// A 16-bit sample of v: values past IMAGE_MAXVAL (max_iter > 65535) are scaled down onto it
+static inline __attribute__((always_inline))
+uint32_t image_sample16(const ImageWriter *w, uint32_t v) {
+    return w->max_iter > IMAGE_MAXVAL ? (uint32_t)((uint64_t)v * IMAGE_MAXVAL / w->max_iter) : v;
+}
+
+// Packs one row into p (scanline + 1); inlined once per element width
+static inline __attribute__((always_inline))
+void image_pack_row(const ImageWriter *w, const void *row, int bytes, uint8_t *p) {
+    if (w->rgb) {
+        memcpy(p, row, (size_t)3 * w->width);
+    } else if (w->format == FORMAT_RAW16) {
+        for (int x = 0; x < w->width; ++x) {
+            uint32_t v = image_sample16(w, image_sample(row, x, bytes));
+            *p++ = (uint8_t)v;
+            *p++ = (uint8_t)(v >> 8);
+        }
+    } else if (w->format == FORMAT_PNG) {
+        // PNG has no maxval, so samples are scaled to the full bit depth
+        uint64_t full = w->depth == 1 ? 255 : 65535;
+        uint64_t max = w->max_iter > 0 ? (uint64_t)w->max_iter : 1;
+        for (int x = 0; x < w->width; ++x) {
+            uint32_t v = (uint32_t)((uint64_t)image_sample(row, x, bytes) * full / max);
+            if (w->depth == 2) *p++ = (uint8_t)(v >> 8);
+            *p++ = (uint8_t)v;
+        }
+    } else if (w->format == FORMAT_PPM) {
+        // Grey: the same sample in all three channels
+        for (int x = 0; x < w->width; ++x) {
+            uint32_t v = image_sample16(w, image_sample(row, x, bytes));
+            for (int c = 0; c < 3; ++c) {
+                if (w->depth == 2) *p++ = (uint8_t)(v >> 8);
+                *p++ = (uint8_t)v;
+            }
+        }
+    } else if (w->depth == 2) {
+        for (int x = 0; x < w->width; ++x) {
+            uint32_t v = image_sample16(w, image_sample(row, x, bytes));
+            *p++ = (uint8_t)(v >> 8);
+            *p++ = (uint8_t)v;
+        }
+    } else {
+        for (int x = 0; x < w->width; ++x) {
+            *p++ = (uint8_t)image_sample(row, x, bytes);
+        }
+    }
+}
+
+void image_write_row(ImageWriter *w, const void *row, int bytes) {
+    switch (bytes) {
+    case 1: image_pack_row(w, row, 1, w->scanline + 1); break;
+    case 2: image_pack_row(w, row, 2, w->scanline + 1); break;
+    default: image_pack_row(w, row, 4, w->scanline + 1); break;
+    }
+    w->scanline[0] = 0; // PNG filter type: none
+
+    if (w->format == FORMAT_PNG) {
+        png_deflate_row(w);
+        uint8_t *tmp = w->previous;
+        w->previous = w->scanline;
+        w->scanline = tmp;
+    } else {
+        fwrite(w->scanline + 1, 1, w->stride - 1, w->out);
+    }
+    w->rows_written++;
+}
+
+void image_pack(const ImageWriter *w, const void *row, int bytes, uint8_t *dest) {
+    switch (bytes) {
+    case 1: image_pack_row(w, row, 1, dest); break;
+    case 2: image_pack_row(w, row, 2, dest); break;
+    default: image_pack_row(w, row, 4, dest); break;
+    }
+}
+
+void image_end(ImageWriter *w) {
+    if (w->format == FORMAT_PNG) {
+        deflate_symbol(w, 256);    // end of block
+        deflate_bits(w, 0, 7);     // pad to a byte boundary
+        w->bits = 0;
+        w->nbits = 0;
+        put_be32(w->zbuf + w->zlen, w->adler_b << 16 | w->adler_a);
+        w->zlen += 4;
+        png_flush_idat(w);
+        png_chunk(w->out, "IEND", NULL, 0);
+    }
+    free(w->scanline);
+    free(w->previous);
+    free(w->zbuf);
+}
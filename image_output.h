@@ -0,0 +1,126 @@
+/**
+ * @file image_output.h
+ * @brief Binary image writers (PGM, PPM, raw 16-bit, PNG) fed one row at a time.
+ *
+ * Part of libmandelbrot (image_output.c), but usable on its own. Rows are
+ * passed top row first as iteration values in [0, max_iter] and written
+ * straight to the stream: nothing is buffered beyond one row (plus up to
+ * IDAT_CHUNK bytes of compressed PNG data). image_begin_rgb() writers take
+ * rows of 8-bit RGB triples instead.
+ *
+ * The PNG encoder emits a single fixed-Huffman deflate block. Matches are
+ * limited to runs (distance 1, or 3 for RGB) and repeats of the row above
+ * (distance = scanline), which captures most of the redundancy in
+ * escape-time images without a hash chain.
+ */
+
+#ifndef IMAGE_OUTPUT_H
+#define IMAGE_OUTPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMAGE_HEADER_MAX 64 // Longest PGM/PPM header
+#define IMAGE_MAXVAL 65535  // Largest PGM/PPM maxval and raw16 sample; larger max_iter is scaled onto it
+
+typedef enum {
+    FORMAT_ASCII, // ASCII art
+    FORMAT_TEXT,  // gnuplot matrix text (png=1)
+    FORMAT_PGM,   // binary PGM, maxval = max_iter (at most IMAGE_MAXVAL, larger values scaled)
+    FORMAT_RAW16, // headerless little-endian uint16 samples, scaled like PGM above IMAGE_MAXVAL
+    FORMAT_PNG,   // greyscale PNG, 8-bit up to max_iter 255, else 16-bit; RGB with a palette
+    FORMAT_PPM,   // binary PPM: grey, maxval as PGM; RGB with a palette
+    FORMAT_HALF,  // Unicode half blocks in 24-bit ANSI colour, two rows per line
+    FORMAT_ANSI   // ASCII art in 24-bit ANSI colour
+} OutputFormat;
+
+typedef struct {
+    FILE *out;
+    OutputFormat format;
+    int width;
+    int height;
+    int max_iter;
+    int depth;          // Bytes per sample (1 or 2); raw16 is always 2
+    bool rgb;           // Rows are RGB triples (image_begin_rgb())
+    int rows_written;
+    uint8_t *scanline;  // PNG: filter byte + samples of the current row
+    uint8_t *previous;  // PNG: the row above, for distance = scanline matches
+    size_t stride;      // PNG: scanline length in bytes
+    uint8_t *zbuf;      // PNG: compressed bytes waiting for the next IDAT
+    size_t zlen;
+    uint64_t bits;      // PNG: deflate bit accumulator (LSB first)
+    int nbits;
+    uint32_t adler_a;
+    uint32_t adler_b;
+} ImageWriter;
+
+/**
+ * @brief Maps a format= value to an OutputFormat.
+ * @param name The value string.
+ * @param format Receives the format if the name is known.
+ * @return false if the name is not a known format.
+ */
+bool parse_format(const char *name, OutputFormat *format);
+
+/**
+ * @brief Writes the header of a binary image and prepares per-row state.
+ * @param w The writer to initialise.
+ * @param out The stream to write to.
+ * @param format FORMAT_PGM, FORMAT_PPM, FORMAT_RAW16 or FORMAT_PNG.
+ * @param width The image width in pixels.
+ * @param height The image height in pixels.
+ * @param max_iter The largest value a pixel can take.
+ */
+void image_begin(ImageWriter *w, FILE *out, OutputFormat format, int width, int height,
+                 int max_iter);
+
+/**
+ * @brief image_begin() for rows of 8-bit RGB triples.
+ * @param format FORMAT_PPM or FORMAT_PNG.
+ */
+void image_begin_rgb(ImageWriter *w, FILE *out, OutputFormat format, int width, int height);
+
+/**
+ * @brief Writes the next row (top row first).
+ * @param w The writer.
+ * @param row width iteration values in [0, max_iter], or width RGB triples.
+ * @param bytes Width of each value: 1 (uint8_t), 2 (uint16_t) or 4 (int);
+ *        ignored for RGB rows.
+ */
+void image_write_row(ImageWriter *w, const void *row, int bytes);
+
+/**
+ * @brief Describes an image written into a preallocated file instead of a stream.
+ *
+ * For the fixed-size formats (PGM, PPM, raw16): every row packs to
+ * w->stride - 1 bytes, so row r lives at header length + r * (stride - 1)
+ * and rows may be packed in any order with image_pack().
+ * @param w The writer to initialise; it owns no buffers.
+ * @param format FORMAT_PGM, FORMAT_PPM or FORMAT_RAW16.
+ * @param width, height, max_iter As for image_begin().
+ * @param rgb Rows are RGB triples (as image_begin_rgb(); max_iter is ignored).
+ * @param header Receives the header, at most IMAGE_HEADER_MAX bytes.
+ * @return The header length.
+ */
+size_t image_layout(ImageWriter *w, OutputFormat format, int width, int height, int max_iter,
+                    bool rgb, char *header);
+
+/**
+ * @brief Packs one row as image_write_row() would write it, into dest.
+ *
+ * Does not modify w, so any number of threads may pack rows at once.
+ * @param w A writer from image_layout().
+ * @param row, bytes As for image_write_row().
+ * @param dest Receives w->stride - 1 bytes.
+ */
+void image_pack(const ImageWriter *w, const void *row, int bytes, uint8_t *dest);
+
+/**
+ * @brief Finishes the image (PNG trailer) and releases the writer's buffers.
+ * @param w The writer.
+ */
+void image_end(ImageWriter *w);
+
+#endif // IMAGE_OUTPUT_H
@@ -0,0 +1,625 @@
+/**
+ * @file mandelbrot.h
+ * @brief libmandelbrot - escape-time rendering of the Mandelbrot set.
+ *
+ * render() fills a caller-owned buffer with iteration values; render_bands()
+ * hands the frame over in row bands while later bands are still being
+ * computed. Neither keeps any global state: every call owns its workers,
+ * scheduler and scratch memory, so renders may run concurrently from any
+ * number of threads (e.g. one per request in a tile server). Programs that
+ * render many frames keep a RenderPool instead, so the worker threads and
+ * their scratch memory are created once rather than per frame.
+ *
+ * Values are stored in the narrowest unsigned type that holds max_iter
+ * (see config_pixel_bytes()): uint8_t up to 255, uint16_t up to 65535 and
+ * uint32_t above. With smooth=1 they are the continuous escape value as
+ * uint16_t fixed point instead, SMOOTH_ONE for a point that escapes at once.
+ * With a palette and format=png or ppm, the workers colour each row as soon
+ * as it is computed and the buffers hold RGB triples (config_output_bytes()).
+ *
+ * The command-line programs are thin front-ends: they fill a Config with
+ * parse_arg() and call frontend_main() (mandelbrot, mandelbrot_pthread), or
+ * use parse_arg() and cnt2char() around their own kernel
+ * (mandelbrot_complex).
+ */
+
+#ifndef MANDELBROT_H
+#define MANDELBROT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image_output.h"
+
+#define SMOOTH_ONE 65535 // smooth=1: the value of max_iter - mu = max_iter
+
+#define AA_MAX 16 // Largest aa=N
+#define PROGRESSIVE_STEP 8 // progressive=1: pixel step of the first, coarsest pass
+#define HUGE_PAGE (2u << 20) // hugepages=1: allocation granularity (x86-64 and arm64 2 MB pages)
+
+#define PYRAMID_TILE      256   // pyramid=1: tile edge in pixels
+#define PYRAMID_LL_X      (-2.5) // Level 0 is the one tile [-2.5, 1.5] x [-2, 2]
+#define PYRAMID_UR_Y      2.0
+#define PYRAMID_SPAN      4.0
+#define PYRAMID_MAX_LEVEL 48    // Deepest level whose tile corners are exact doubles
+
+typedef enum {
+    SCHED_TILES, // square tiles, per-thread deques with work stealing
+    SCHED_ROWS   // row chunks from a shared counter
+} Schedule;
+
+typedef enum {
+    ALGO_ESCAPE, // every pixel through the row kernel
+    ALGO_MARIANI // Mariani-Silver rectangle subdivision
+} Algorithm;
+
+typedef enum {
+    ENGINE_DOUBLE, // direct iteration in double
+    ENGINE_PERTURB, // high-precision reference orbit + double deltas, for deep zooms
+    ENGINE_GPU      // OpenCL device; the CPU kernels when there is none
+} Engine;
+
+typedef enum {
+    PRECISION_AUTO,   // float, double or long double from the pixel spacing
+    PRECISION_FLOAT,  // twice the vector lanes of double
+    PRECISION_DOUBLE,
+    PRECISION_LONG    // scalar long double (80-bit on x86), past double's range
+} Precision;
+
+typedef enum {
+    EASE_LINEAR, // constant zoom speed
+    EASE_IN,     // start slow, speed up
+    EASE_OUT,    // start fast, slow down
+    EASE_INOUT   // slow at both ends
+} Easing;
+
+typedef enum {
+    PALETTE_NONE,   // output the values
+    PALETTE_GREY,   // white far from the set to black, like topng.gp
+    PALETTE_FIRE,   // black, red, yellow, white towards the set
+    PALETTE_OCEAN,  // dark blue, cyan, white towards the set
+    PALETTE_RAINBOW // one hue cycle over [0, max_iter]
+} Palette;
+
+typedef struct PerturbOrbit PerturbOrbit;
+typedef struct RenderPool RenderPool;
+typedef struct ColourMap ColourMap;
+typedef struct TileCache TileCache;
+typedef struct Histogram Histogram;
+
+typedef struct {
+    int width;
+    int height;
+    OutputFormat format;
+    bool simd;
+    bool unroll;   // Vector kernel: test whether all lanes escaped every few steps, not every step
+    bool interior; // Skip the iteration loop inside the main cardioid and period-2 bulb
+    bool period;   // Brent cycle detection: leave the loop early on periodic orbits
+    bool stats;    // Per-thread work and timing table plus load-imbalance summary on stderr
+    int threads;  // Worker threads; 0 = number of online CPUs
+    bool pin;     // Pin each worker to one CPU and place frame buffers for them (render_pool_pin())
+    bool hugepages; // Back frame buffers with huge pages (render_pool_alloc())
+    int chunk;    // Rows per task (sched=rows); 0 = auto-tune from width * max_iter
+    Schedule sched;
+    int tile;     // Tile edge in pixels (sched=tiles)
+    Algorithm algo;
+    Engine engine;
+    Precision precision; // Arithmetic of the escape kernels (engine=double)
+    bool stream;  // Compute row bands into a ring buffer and write them as they complete
+    int band;     // Rows per band (stream=1); 0 = chunk size
+    int bands;    // Bands in the ring (stream=1); 0 = 2 * threads
+    double ll_x;
+    double ll_y;
+    double ur_x;
+    double ur_y;
+    const char *ll_x_str; // Coordinates as given, for the fixed-point reference orbit;
+    const char *ll_y_str; // set by parse_arg(); NULL (the default) = use the doubles above
+    const char *ur_x_str;
+    const char *ur_y_str;
+    int max_iter;
+    bool smooth;     // Store max_iter - mu (log-log smoothing) as fixed point, not the count
+    int aa;          // Supersample pixels that differ from a neighbour aa x aa times (render_pool_frame())
+    Palette palette; // Colour format=png, ppm, half and ansi output through a lookup table
+    const char *symbols; // Glyph ramp of format=ascii and ansi, in the set first; NULL = default
+    int bench;       // Timed runs for bench=N; 0 renders normally
+    int frames;      // Frames to render with one thread pool; 0 = a single frame
+    double zoom;     // Span factor from one frame to the next (frames=N without keyframes)
+    const char *keyframes; // File of views to interpolate between (frames=N); NULL = none
+    bool has_end;    // end= was given: frames=N runs from the view to end_*
+    double end_ll_x;
+    double end_ll_y;
+    double end_ur_x;
+    double end_ur_y;
+    Easing ease;     // Progress curve over the frames
+    const char *frame_out; // printf pattern with one %d for a file per frame; NULL = stdout
+    const char *out_path; // out=: write the frame to this file, formatted in place; NULL = stdout
+    bool pyramid;    // Assemble the view from cached z/x/y tiles (render_pyramid())
+    const char *tile_dir; // pyramid=1: on-disk tile cache directory; NULL = memory only
+    int tile_cache;  // pyramid=1: tiles kept in memory
+    bool pipeline;   // frames=N: write frame N on its own thread while N+1 is computed
+    const char *nodes; // nodes=: host:port list of render nodes to shard the frame over; NULL = local
+    const char *serve; // serve=: run as a render node on this TCP port; NULL = off
+    bool progressive; // Write passes at 1/8, 1/4, 1/2 and full resolution (render_pool_progressive())
+    const char *hist; // hist=: write the frame's value histogram and summary to this file; NULL = none
+    int pixel_bytes; // Set by render() on its own copy: config_pixel_bytes()
+    int output_bytes; // Set by render() on its own copy: config_output_bytes()
+    int x_step;      // Set by render() on its own copy: columns between the pixels a row kernel computes
+    const ColourMap *colours; // Set by render() on its own copy (config_rgb())
+    const PerturbOrbit *orbit; // Set by render() on its own copy (engine=perturb)
+    long double ll_x_long;     // Set by render() on its own copy: the view for precision=long,
+    long double ll_y_long;     // parsed from the *_str coordinates where given
+    long double ur_x_long;
+    long double ur_y_long;
+} Config;
+
+typedef struct {
+    long long periodic; // Pixels that left the loop on a detected cycle (period=1)
+    long long filled;   // Pixels filled from a uniform border without iterating (algo=mariani)
+    long long rebases;  // Glitch rebases onto the start of the reference orbit (engine=perturb)
+    long long iterations; // Inner-loop passes run; vector kernels count SIMD_LANES per pass
+    int orbit_len;        // Reference orbit length (engine=perturb)
+    long long tiles_memory;   // pyramid=1: tiles found in the memory cache
+    long long tiles_disk;     // pyramid=1: tiles read from the disk cache
+    long long tiles_rendered; // pyramid=1: tiles computed
+    int tile_level;           // pyramid=1: the level of the last view
+    long long reused;         // Pixels kept from the previous frame (render_pool_pan())
+    long long supersampled;   // Edge pixels recomputed from aa x aa samples
+    Histogram *histogram;     // hist=: pixels per value (histogram_create()), added to by
+                              // every render; NULL = not counted
+} KernelStats;
+
+/**
+ * @brief Receives one band of render_bands(), in output order.
+ * @param ctx The pointer passed to render_bands().
+ * @param y_lo The image row held by the first row of data.
+ * @param rows The number of rows in the band.
+ * @param data The band's values (or colours), config_output_bytes() each.
+ * @param stride Bytes from one row of data to the next.
+ */
+typedef void (*band_fn)(void *ctx, int y_lo, int rows, const void *data, size_t stride);
+
+/**
+ * @brief The defaults of the command-line programs; threads = 0 (all CPUs).
+ */
+Config config_default(void);
+
+/**
+ * @brief Parses a single "key=value" command-line argument.
+ *
+ * String values (the *_str coordinates) point into arg, which must outlive
+ * the Config.
+ * @param arg The string argument from argv.
+ * @param config A pointer to the configuration struct to be updated.
+ */
+void parse_arg(char *arg, Config *config);
+
+/**
+ * @brief Element width of render() buffers for this configuration.
+ * @return 1, 2 or 4 (uint8_t, uint16_t or uint32_t).
+ */
+int config_pixel_bytes(const Config *config);
+
+// The largest value in render() buffers: max_iter, or SMOOTH_ONE with smooth=1
+int config_value_max(const Config *config);
+
+// A palette is set and the format takes colour (png, ppm)
+bool config_rgb(const Config *config);
+
+/**
+ * @brief Element width of render() and render_bands() output.
+ * @return 3 (RGB) when config_rgb(), otherwise config_pixel_bytes().
+ */
+int config_output_bytes(const Config *config);
+
+/*
+ * Element i of a render buffer of bytes-wide values (config_pixel_bytes()).
+ * With bytes a literal, each of these inlines to a single load or store
+ * and nothing branches per pixel.
+ */
+static inline __attribute__((always_inline))
+void store_iter(void *out, size_t i, int value, int bytes) {
+    if (bytes == 1) ((uint8_t *)out)[i] = (uint8_t)value;
+    else if (bytes == 2) ((uint16_t *)out)[i] = (uint16_t)value;
+    else ((uint32_t *)out)[i] = (uint32_t)value;
+}
+
+static inline __attribute__((always_inline))
+int load_iter(const void *in, size_t i, int bytes) {
+    if (bytes == 1) return ((const uint8_t *)in)[i];
+    if (bytes == 2) return ((const uint16_t *)in)[i];
+    return (int)((const uint32_t *)in)[i];
+}
+
+/**
+ * @brief Calculates the escape time for a point in the complex plane.
+ * @param cr The real part of the complex number c.
+ * @param ci The imaginary part of the complex number c.
+ * @param max_iter The maximum number of iterations.
+ * @return An integer representing how close the point is to the set.
+ */
+int escape_time(double cr, double ci, int max_iter);
+
+/**
+ * @brief Renders the frame described by config into out.
+ * @param config A pointer to the configuration struct. stream is ignored.
+ * @param out height rows of width values (or colours), config_output_bytes() each.
+ * @param stride Bytes from one row of out to the next.
+ * @param stats Accumulates kernel counters and, with stats->histogram set,
+ *        the frame's values (counted by the workers as they compute them);
+ *        may be NULL.
+ */
+void render(const Config *config, void *out, size_t stride, KernelStats *stats);
+
+/**
+ * @brief Renders the frame as row bands and passes each to fn, in order.
+ *
+ * Workers compute bands into a ring of config->bands slots of config->band
+ * rows; fn runs on the calling thread while later bands are computed, and
+ * each slot is reused once fn returns. Memory is bounded by the ring, not
+ * the frame size.
+ * @param config A pointer to the configuration struct.
+ * @param bottom_up Deliver the bottom band first (the gnuplot matrix order).
+ * @param fn Called once per band.
+ * @param ctx Passed to fn.
+ * @param stats Accumulates kernel counters; may be NULL.
+ */
+void render_bands(const Config *config, bool bottom_up, band_fn fn, void *ctx,
+                  KernelStats *stats);
+
+/**
+ * @brief Starts a pool of worker threads for render_pool_frame().
+ * @param threads The number of workers; 0 = number of online CPUs.
+ * @return The pool; exits on failure.
+ */
+RenderPool *render_pool_create(int threads);
+
+/**
+ * @brief Stops and joins the workers and frees the pool.
+ * @param pool The pool, idle (no render in progress).
+ */
+void render_pool_destroy(RenderPool *pool);
+
+// The number of workers in pool
+int render_pool_threads(const RenderPool *pool);
+
+/**
+ * @brief Pins worker i to the i-th CPU the process may run on (wrapping
+ * around when there are more workers than CPUs).
+ *
+ * Each worker then stays next to its caches and, on NUMA machines, to the
+ * memory it first-touched, such as its band of a render_pool_alloc() buffer.
+ * @return false if affinity is not supported here (Linux only) or was refused.
+ */
+bool render_pool_pin(RenderPool *pool);
+
+/**
+ * @brief Allocates a frame buffer whose pages belong to the workers that compute them.
+ *
+ * The buffer is split into one band of rows per worker, in worker order;
+ * each worker first-touches the pages of its band, so the kernel places
+ * them on that worker's NUMA node. sched=tiles deals each worker the tiles
+ * of its band first, so most pixels are written by the worker next to them.
+ * The pages are zero.
+ * @param size Bytes (stride * height).
+ * @param huge Use huge pages: reserved ones if the system has them, else
+ *        transparent huge pages where enabled; the size is rounded up to
+ *        HUGE_PAGE.
+ * @return The buffer, for render_pool_free(); exits on failure.
+ */
+void *render_pool_alloc(RenderPool *pool, size_t size, bool huge);
+
+// Frees a render_pool_alloc() buffer; size and huge as passed to it
+void render_pool_free(void *buffer, size_t size, bool huge);
+
+/**
+ * @brief render() on the pool's workers; config->threads is ignored.
+ *
+ * One frame at a time per pool: the calling thread waits for the frame.
+ * With aa > 1, every pixel whose value (or colour) differs from one of its
+ * four neighbours is then recomputed as the mean of aa x aa samples spread
+ * evenly over the pixel, in colour with a palette. render() and
+ * render_pool_frame() are the only entry points that do this; such pixels
+ * count in stats->histogram with their value before supersampling.
+ */
+void render_pool_frame(RenderPool *pool, const Config *config, void *out, size_t stride,
+                       KernelStats *stats);
+
+/**
+ * @brief render_pool_frame() into a buffer that already holds the frame of prev.
+ *
+ * If config's view is prev's moved by a whole number of pixels, with the
+ * same size, scale and values (max_iter, smooth, precision, palette,
+ * engine, algo, simd, unroll, interior, period), the pixels still in view
+ * are moved within out and only the newly exposed strips are computed.
+ * Reused pixels keep prev's values, which a fresh render could differ from
+ * in the rounding of the pixel coordinates (and, with algo=mariani, in the
+ * block layout of the fills). engine=gpu, engine=perturb (whose reference
+ * orbit moves with the view), aa=, views too deep for the doubles to place
+ * the shift, and any other change render the whole frame, as does
+ * stats->histogram, which needs every pixel counted.
+ * @param prev The configuration out was last rendered with (same stride).
+ * @return true if pixels were reused (see stats->reused).
+ */
+bool render_pool_pan(RenderPool *pool, const Config *prev, const Config *config, void *out,
+                     size_t stride, KernelStats *stats);
+
+/**
+ * @brief Renders rows [y_lo, y_lo + rows) of config's frame on the pool's workers.
+ *
+ * The rows hold the same values as in a whole render_pool_frame(), except
+ * for the block layout of algo=mariani fills. engine=gpu renders on the
+ * CPU and aa= is not applied, since edges need the neighbouring rows.
+ * stats->histogram counts these rows only. This is what a render node
+ * computes for each shard (see cluster_serve()).
+ * @param out rows rows, from image row y_lo.
+ * @param stride Bytes from one row of out to the next.
+ */
+void render_pool_region(RenderPool *pool, const Config *config, int y_lo, int rows, void *out,
+                        size_t stride, KernelStats *stats);
+
+/**
+ * @brief Receives each pass of render_pool_progressive(), on the calling thread.
+ * @param ctx The pointer passed to render_pool_progressive().
+ * @param step The pass: every pixel shows the value at the top left of its
+ *        step x step block (PROGRESSIVE_STEP down to 1, the final frame).
+ * @param frame, stride The whole frame, as for render().
+ */
+typedef void (*pass_fn)(void *ctx, int step, const void *frame, size_t stride);
+
+/**
+ * @brief render_pool_frame() in passes of increasing resolution.
+ *
+ * The first pass computes every PROGRESSIVE_STEP-th pixel of every
+ * PROGRESSIVE_STEP-th row; each further pass halves the step and computes
+ * only the pixels the coarser passes have not, so the passes together cost
+ * one frame and the final one equals render(). After each pass the blocks
+ * are filled from their computed corner and the frame is handed to fn.
+ * algo=mariani, engine=gpu and aa= are not used (the escape kernels
+ * compute every pass).
+ * @param fn Called after each pass; may be NULL.
+ * @return false if render_pool_cancel() stopped the render: out then holds
+ *         the last pass passed to fn, partly refined.
+ */
+bool render_pool_progressive(RenderPool *pool, const Config *config, void *out, size_t stride,
+                             pass_fn fn, void *ctx, KernelStats *stats);
+
+/**
+ * @brief Stops the render_pool_progressive() running on pool, e.g. when the
+ * view has changed.
+ *
+ * Safe to call from any thread, including from fn. The workers stop after
+ * their current task and no further pass is delivered. A call while the
+ * pool is idle has no effect; the next render clears it.
+ */
+void render_pool_cancel(RenderPool *pool);
+
+// render_bands() on the pool's workers; config->threads is ignored
+void render_pool_bands(RenderPool *pool, const Config *config, bool bottom_up, band_fn fn,
+                       void *ctx, KernelStats *stats);
+
+/**
+ * @brief Renders the frame in chunks of config->chunk full rows and passes
+ * each to fn on the worker that computed it.
+ *
+ * fn runs concurrently on all workers and sees the chunks in no particular
+ * order, so it must be thread-safe (e.g. mapped_output_rows()). Each worker
+ * keeps one chunk buffer; there is no frame buffer. config->stream and
+ * config->sched are ignored.
+ */
+void render_pool_rows(RenderPool *pool, const Config *config, band_fn fn, void *ctx,
+                      KernelStats *stats);
+
+/**
+ * @brief Creates a cache of pyramid tiles for render_pyramid().
+ *
+ * Tile (z, x, y) covers 1/2^z of the level-0 square on each side, x
+ * counting to the right from PYRAMID_LL_X and y down from PYRAMID_UR_Y, and
+ * holds PYRAMID_TILE x PYRAMID_TILE values. Tiles are keyed by (z, x, y,
+ * max_iter, precision, engine, algo, interior, period, smooth), the options
+ * that change tile values; the others are not part of the key.
+ * The cache is thread-safe, so a tile server can share one between request
+ * threads (each with its own pool).
+ * @param capacity Tiles kept in memory; the least recently used go first.
+ * @param dir Directory of the on-disk cache, created if missing; tiles are
+ *        stored as dir/z/x/y-max_iter-precision-engine-algo[-nointerior]
+ *        [-period][-smooth].tile in native byte order, e.g.
+ *        3/2/3-255-double-double-escape.tile. NULL keeps tiles in memory only.
+ * @return The cache; exits on failure.
+ */
+TileCache *tile_cache_create(int capacity, const char *dir);
+
+void tile_cache_destroy(TileCache *cache);
+
+// Sets config's view and size to tile (z, x, y)
+void pyramid_tile_view(Config *config, int z, long long x, long long y);
+
+/**
+ * @brief Copies tile (z, x, y) into out, rendering it on pool if no cache has it.
+ *
+ * A rendered tile is added to the memory cache and written to the disk
+ * cache. Two threads missing the same tile both render it.
+ * @param cache The cache.
+ * @param pool Renders missing tiles.
+ * @param config A pointer to the configuration struct (the view is ignored).
+ * @param z, x, y The tile.
+ * @param out PYRAMID_TILE rows of PYRAMID_TILE values, config_pixel_bytes() each.
+ * @param stats Accumulates kernel and tile counters; may be NULL.
+ */
+void tile_cache_get(TileCache *cache, RenderPool *pool, const Config *config, int z, long long x,
+                    long long y, void *out, KernelStats *stats);
+
+/**
+ * @brief render_pool_frame() through the tile pyramid.
+ *
+ * Picks the coarsest level whose pixels are no larger than the view's (at
+ * most PYRAMID_MAX_LEVEL), fetches the tiles under the view with
+ * tile_cache_get() and samples each view pixel from the nearest tile
+ * pixel, so only tiles that no cache holds are computed. A view on the
+ * tile grid at the level's resolution is copied exactly. stats->histogram
+ * counts the view's pixels, not the tiles'.
+ * @param out height rows of width values (or colours), config_output_bytes() each.
+ */
+void render_pyramid(TileCache *cache, RenderPool *pool, const Config *config, void *out,
+                    size_t stride, KernelStats *stats);
+
+/**
+ * @brief Renders config's frame on remote render nodes and writes it to out.
+ *
+ * The frame is split into shards of full rows, handed out to the nodes on
+ * demand and sized from each node's measured rows per second, so fast and
+ * slow nodes finish together. Nodes return the values, in the narrowest
+ * type (config_pixel_bytes()); the calling thread colours them and writes
+ * them in order while later shards are still being computed, keeping at
+ * most about 256 MB of received rows ahead of the writer. The shards of a
+ * node that fails are rendered by the others. aa= is not applied.
+ * @param nodes Comma-separated host:port list of cluster_serve() nodes.
+ * @param out The stream config->format is written to.
+ * @param histogram Adds the frame's values, counted as the rows are
+ *        written (see KernelStats.histogram); NULL = none. The kernel
+ *        counters stay on the nodes.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if no node could render the frame.
+ */
+int cluster_render(const Config *config, const char *nodes, FILE *out, Histogram *histogram);
+
+/**
+ * @brief Serves render_pool_region() shards to cluster_render() coordinators.
+ *
+ * Listens on port and renders the jobs of one coordinator at a time on
+ * pool. The view, size and value options come from the coordinator; the
+ * node's own config supplies the rest (threads, sched, tile, chunk, stats).
+ * Nodes and coordinator must agree on byte order for values wider than
+ * one byte; the coordinator skips nodes that do not.
+ * @return EXIT_FAILURE once the port cannot be served; otherwise it does not return.
+ */
+int cluster_serve(RenderPool *pool, const Config *config, const char *port);
+
+/**
+ * @brief Maps an iteration count to an ASCII character.
+ * @param value The iteration value (0 to max_iter).
+ * @param max_iter The maximum number of iterations (config_value_max()).
+ * @return A character for visualization.
+ */
+char cnt2char(int value, int max_iter);
+
+typedef struct {
+    const Config *config;
+    FILE *out;
+    int bytes;         // Element width of the rows passed to output_row() (3: RGB)
+    char *text;        // One formatted row (text formats)
+    size_t text_size;  // Bytes of text: enough for any row plus 64 bytes of slack
+    char *glyphs;      // ascii/ansi: the glyph of every value; NULL above 65535 values
+    ColourMap *colours; // half/ansi: palette table (grey without palette=)
+    uint8_t *rgb;      // half/ansi: colours of the row (half: the upper and lower row)
+    bool has_pending;  // half: the upper row of the current line is in rgb
+    ImageWriter image; // Binary formats
+} OutputWriter;
+
+/**
+ * @brief Starts writing an image in config->format.
+ * @param w The writer.
+ * @param config A pointer to the configuration struct.
+ * @param out The output stream.
+ */
+void output_begin(OutputWriter *w, const Config *config, FILE *out);
+
+/**
+ * @brief Writes the next row in output order (bottom first for FORMAT_TEXT).
+ * @param w The writer.
+ * @param row_start The row's width iteration values, config_output_bytes() each.
+ */
+void output_row(OutputWriter *w, const void *row_start);
+
+void output_end(OutputWriter *w);
+
+/**
+ * @brief Writes a whole frame produced by render() in config->format.
+ * @param config A pointer to the configuration struct.
+ * @param buffer The frame.
+ * @param stride Bytes from one row of buffer to the next.
+ * @param out The output stream.
+ */
+void write_frame(const Config *config, const void *buffer, size_t stride, FILE *out);
+
+/**
+ * @brief Creates an empty histogram for KernelStats.histogram.
+ *
+ * The memory is bounded whatever max_iter is: a table for the 65536 values
+ * nearest value_max and a map, grown as needed, for the values seen below.
+ * @param value_max The largest value counted: config_value_max().
+ */
+Histogram *histogram_create(int value_max);
+
+void histogram_free(Histogram *h);
+
+/**
+ * @brief Adds n values to a histogram (KernelStats.histogram).
+ * @param values The values, bytes each (1, 2 or 4), each at most its value_max.
+ */
+void histogram_add(Histogram *h, const void *values, int n, int bytes);
+
+/**
+ * @brief Writes hist=: the summary of a frame's values and the count of each one.
+ *
+ * Text, for gnuplot and scripts: '#' lines with the size and options, the
+ * pixel count, the interior pixels (value 0: in the set, or still bounded
+ * after max_iter iterations) and the minimum, maximum and mean escape
+ * iteration of the others, then "value count" for every value that occurs.
+ * With smooth=1 the escape iterations are fractional, as in bench CSV.
+ * @param histogram The frame's counts (KernelStats.histogram).
+ */
+void write_histogram(const Config *config, const Histogram *histogram, FILE *out);
+
+/**
+ * A file of fixed-size rows, preallocated and mapped, so that any thread
+ * can format any row straight into place. FORMAT_TEXT values are padded to
+ * the width of the largest value for this.
+ */
+typedef struct {
+    const Config *config;
+    int fd;
+    char *map;
+    size_t size;
+    size_t header;      // Bytes before the first row
+    size_t row_bytes;   // Bytes per row, newline included
+    int field;          // text: characters per value
+    char *glyphs;       // ascii: the glyph of every value; NULL above 65535 values
+    ImageWriter image;  // pgm, ppm, raw16: the row layout (image_layout())
+} MappedOutput;
+
+/**
+ * @brief Creates path at the frame's final size and maps it.
+ * @param m The output to initialise.
+ * @param config A pointer to the configuration struct.
+ * @param path The file to write.
+ * @return false if config->format has no fixed row size (png, half, ansi);
+ *         exits if the file cannot be created.
+ */
+bool mapped_output_open(MappedOutput *m, const Config *config, const char *path);
+
+/**
+ * @brief Formats rows into the mapping; a band_fn for render_pool_rows().
+ *
+ * Safe to call from several threads at once for different rows.
+ * @param ctx The MappedOutput.
+ * @param y_lo, rows, data, stride As for band_fn (image rows, any order).
+ */
+void mapped_output_rows(void *ctx, int y_lo, int rows, const void *data, size_t stride);
+
+// Unmaps and closes the file; exits on a write error
+void mapped_output_close(MappedOutput *m);
+
+/**
+ * @brief The shared main() of mandelbrot and mandelbrot_pthread.
+ *
+ * Parses argv over defaults, renders (or streams, or benchmarks) and writes
+ * the image to stdout, with the kernel reports on stderr.
+ * @param argc, argv As passed to main().
+ * @param defaults The program's defaults.
+ * @param program The name used in bench CSV lines.
+ * @return The exit status.
+ */
+int frontend_main(int argc, char *argv[], Config defaults, const char *program);
+
+#endif // MANDELBROT_H
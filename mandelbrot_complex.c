@@ -5,46 +5,47 @@
  * A modern C implementation for a cross-language comparison project.
  * It parses command-line arguments in the format key=value.
  * This version uses the <complex.h> header for more expressive math.
+ * Arguments, text formatting and image writers come from libmandelbrot
+ * (see mandelbrot.h); the keys that select its kernels and schedulers
+ * (threads, simd, period, engine, smooth, palette for png/ppm, ...) are
+ * accepted and ignored.
  *
  * Compilation:
- * gcc -std=c23 -o mandelbrot mandelbrot_complex.c -lm -O3
+ * make mandelbrot_complex
  *
  * Usage:
  * ./mandelbrot
  * ./mandelbrot width=120 ll_x=-0.75 ll_y=0.1 ur_x=-0.74 ur_y=0.11
  * ./mandelbrot png=1 width=800 height=600 > mandelbrot.dat
+ * ./mandelbrot format=png width=800 height=600 > mandelbrot.png
+ * ./mandelbrot bench=5 width=1000 height=750   # CSV timings, see bench.h
  */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 #include <stdbool.h>
 #include <math.h>
 #include <complex.h>
 
-typedef struct {
-    int width;
-    int height;
-    bool png;
-    double ll_x;
-    double ll_y;
-    double ur_x;
-    double ur_y;
-    int max_iter;
-} Config;
+#include "mandelbrot.h"
+#include "bench.h"
 
 /**
- * @brief Maps an iteration count to an ASCII character.
- * @param value The iteration value (0 to max_iter).
- * @param max_iter The maximum number of iterations.
- * @return A character for visualization.
+ * @brief Closed-form test for the main cardioid and the period-2 bulb.
+ *
+ * Points inside either region never escape, so escape_time_complex() would run the
+ * full max_iter loop for them.
+ * @param c The complex number to test.
+ * @return true if c is known to be in the set.
  */
-char cnt2char(int value, int max_iter) {
-    const char *symbols = "MW2a_. ";
-    int ns = strlen(symbols);
-    // Map the value [0, max_iter] to an index [0, ns-1]
-    int idx = (int)((double)value / max_iter * (ns - 1));
-    return symbols[idx];
+static inline bool in_main_bulbs(double complex c) {
+    double complex w = c - 0.25;
+    double q = creal(w) * creal(w) + cimag(w) * cimag(w); // |c - 1/4|^2
+    if (q * (q + creal(w)) <= 0.25 * cimag(c) * cimag(c)) {
+        return true; // main cardioid
+    }
+    double complex b = c + 1.0;
+    return creal(b) * creal(b) + cimag(b) * cimag(b) <= 0.0625; // period-2 bulb, |c + 1| <= 1/4
 }
 
 /**
@@ -53,7 +54,7 @@ char cnt2char(int value, int max_iter) {
  * @param max_iter The maximum number of iterations.
  * @return An integer representing how close the point is to the set.
  */
-int escape_time(double complex c, int max_iter) {
+int escape_time_complex(double complex c, int max_iter) {
     double complex z = 0.0 + 0.0 * I; // Start with z = 0
     int iter;
 
@@ -69,95 +70,114 @@ int escape_time(double complex c, int max_iter) {
 }
 
 /**
- * @brief Renders the Mandelbrot set as ASCII art to stdout.
+ * @brief Computes the value of pixel (x, y).
  * @param config A pointer to the configuration struct.
+ * @param x The column.
+ * @param y The row (maps to imag = ur_y - y * fheight / height).
+ * @return The escape_time_complex() value, 0 inside the main bulbs.
  */
-void ascii_output(const Config *config) {
+static int pixel_value(const Config *config, int x, int y) {
     double fwidth = config->ur_x - config->ll_x;
     double fheight = config->ur_y - config->ll_y;
+    double real = config->ll_x + x * fwidth / config->width;
+    double imag = config->ur_y - y * fheight / config->height;
+    double complex c = real + imag * I;
 
-    for (int y = 0; y < config->height; ++y) {
-        for (int x = 0; x < config->width; ++x) {
-            double real = config->ll_x + x * fwidth / config->width;
-            double imag = config->ur_y - y * fheight / config->height;
-            double complex c = real + imag * I;
+    return config->interior && in_main_bulbs(c) ? 0 : escape_time_complex(c, config->max_iter);
+}
 
-            int iter = escape_time(c, config->max_iter);
-            putchar(cnt2char(iter, config->max_iter));
-        }
-        putchar('\n');
+// Computes row y into row, bytes per value (config_pixel_bytes())
+static void compute_row(const Config *config, int y, void *row, int bytes) {
+    for (int x = 0; x < config->width; ++x) {
+        store_iter(row, x, pixel_value(config, x, y), bytes);
     }
 }
 
 /**
- * @brief Generates text output suitable for gnuplot to stdout.
+ * @brief Computes and writes the image one row at a time in config->format.
+ *
+ * The gnuplot matrix samples rows height..1, bottom first, as it always has.
  * @param config A pointer to the configuration struct.
+ * @param out The output stream.
  */
-void gptext_output(const Config *config) {
-    double fwidth = config->ur_x - config->ll_x;
-    double fheight = config->ur_y - config->ll_y;
-
-    for (int y = config->height; y > 0; --y) {
-        for (int x = 0; x < config->width; ++x) {
-            double real = config->ll_x + x * fwidth / config->width;
-            double imag = config->ur_y - y * fheight / config->height;
-            double complex c = real + imag * I;
-
-            int iter = escape_time(c, config->max_iter);
-            // Print comma separator for all but the first value in a row
-            printf("%s%d", (x > 0 ? ", " : ""), iter);
-        }
-        printf("\n");
+static void stream_output(const Config *config, FILE *out) {
+    int bytes = config_pixel_bytes(config);
+    void *row = malloc((size_t)config->width * bytes);
+    if (!row) {
+        perror("Failed to allocate row buffer");
+        exit(EXIT_FAILURE);
+    }
+    OutputWriter writer;
+    output_begin(&writer, config, out);
+    for (int r = 0; r < config->height; ++r) {
+        compute_row(config, config->format == FORMAT_TEXT ? config->height - r : r, row, bytes);
+        output_row(&writer, row);
     }
+    output_end(&writer);
+    free(row);
 }
 
 /**
- * @brief Parses a single "key=value" command-line argument.
- * @param arg The string argument from argv.
- * @param config A pointer to the configuration struct to be updated.
+ * @brief bench=N: times N renders into memory, then N writes of the result.
+ *
+ * Prints one CSV line (see bench.h).
+ * @param config A pointer to the configuration struct.
  */
-void parse_arg(char *arg, Config *config) {
-    char *value = strchr(arg, '=');
-    if (value == NULL) {
-        fprintf(stderr, "Warning: Ignoring invalid argument '%s'\n", arg);
-        return;
+static void bench(const Config *config) {
+    size_t total_pixels = (size_t)config->width * config->height;
+    int bytes = config_pixel_bytes(config);
+    size_t stride = (size_t)config->width * bytes;
+    void *frame = malloc(stride * config->height);
+    if (!frame) {
+        perror("Failed to allocate bench frame");
+        exit(EXIT_FAILURE);
+    }
+    double *compute = bench_alloc(config->bench);
+    double *output = bench_alloc(config->bench);
+    FILE *sink = bench_sink();
+
+    for (int run = 0; run < config->bench; ++run) {
+        double t0 = bench_now();
+        for (int y = 0; y < config->height; ++y) {
+            compute_row(config, y, (char *)frame + y * stride, bytes);
+        }
+        compute[run] = bench_now() - t0;
     }
-    *value = '\0'; // Temporarily split string into key and value
-    value++;       // Move pointer to the start of the value part
-
-    if (strcmp(arg, "width") == 0) config->width = atoi(value);
-    else if (strcmp(arg, "height") == 0) config->height = atoi(value);
-    else if (strcmp(arg, "png") == 0) config->png = (bool)atoi(value);
-    else if (strcmp(arg, "ll_x") == 0) config->ll_x = atof(value);
-    else if (strcmp(arg, "ll_y") == 0) config->ll_y = atof(value);
-    else if (strcmp(arg, "ur_x") == 0) config->ur_x = atof(value);
-    else if (strcmp(arg, "ur_y") == 0) config->ur_y = atof(value);
-    else if (strcmp(arg, "max_iter") == 0) config->max_iter = atoi(value);
-    else fprintf(stderr, "Warning: Unknown parameter '%s'\n", arg);
-
-    *(value - 1) = '='; // Restore the original argument string
+    for (int run = 0; run < config->bench; ++run) {
+        double t0 = bench_now();
+        write_frame(config, frame, stride, sink);
+        fflush(sink);
+        output[run] = bench_now() - t0;
+    }
+
+    long long iterations = 0;
+    for (size_t i = 0; i < total_pixels; ++i) {
+        iterations += config->max_iter - load_iter(frame, i, bytes);
+    }
+    bench_report("mandelbrot_complex", config->width, config->height, config->max_iter, 1,
+                 compute, output, config->bench, iterations);
+
+    fclose(sink);
+    free(output);
+    free(compute);
+    free(frame);
 }
 
 int main(int argc, char *argv[]) {
-    Config config = {
-        .width = 100,
-        .height = 75,
-        .png = false,
-        .ll_x = -1.2,
-        .ll_y = 0.20,
-        .ur_x = -1.0,
-        .ur_y = 0.35,
-        .max_iter = 255
-    };
+    Config config = config_default();
 
     for (int i = 1; i < argc; ++i) {
         parse_arg(argv[i], &config);
     }
+    config.smooth = false; // escape_time_complex() only returns the count
+    if (config_rgb(&config)) {
+        config.palette = PALETTE_NONE; // png/ppm colouring happens in the render workers
+    }
 
-    if (config.png) {
-        gptext_output(&config);
+    if (config.bench > 0) {
+        bench(&config);
     } else {
-        ascii_output(&config);
+        stream_output(&config, stdout);
     }
 
     return EXIT_SUCCESS;
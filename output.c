@@ -0,0 +1,597 @@
+/**
+ * @file output.c
+ * @brief Writes render() buffers as ASCII art, gnuplot text or binary images,
+ * to a stream (OutputWriter) or in place into a mapped file (MappedOutput).
+ */
+
+#define _POSIX_C_SOURCE 200809L // posix_fallocate(), ftruncate() under -std=c23
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mandelbrot.h"
+#include "palette.h"
+
+#define DEFAULT_SYMBOLS "MW2a_. " // Glyph ramp of format=ascii, densest (in the set) first
+#define GLYPH_LUT_MAX   65536     // Larger value ranges map each value with terminal_glyph()
+#define TEXT_BAND_ROWS  32        // Rows per band of the parallel text formatter
+#define TEXT_LUT_MAX    1000      // Values with a precomputed ", ddd" entry
+
+/*
+ * format=text cells: ", " and the decimal digits of every value below
+ * TEXT_LUT_MAX, padded to 8 bytes so a cell is copied with one unaligned
+ * 8-byte store, and the 2-digit pairs for the longer values.
+ */
+static char text_cells[TEXT_LUT_MAX][8];
+static uint8_t text_cell_len[TEXT_LUT_MAX];
+static char digit_pairs[200];
+static pthread_once_t text_cells_once = PTHREAD_ONCE_INIT;
+
+static void text_cells_init(void) {
+    for (int v = 0; v < 100; ++v) {
+        digit_pairs[2 * v] = '0' + v / 10;
+        digit_pairs[2 * v + 1] = '0' + v % 10;
+    }
+    for (int v = 0; v < TEXT_LUT_MAX; ++v) {
+        text_cell_len[v] = (uint8_t)snprintf(text_cells[v], sizeof(text_cells[v]), ", %d", v);
+    }
+}
+
+// Maps the value [0, max] to a glyph of the ns-glyph ramp
+static inline char terminal_glyph(const char *ramp, int ns, int value, int max) {
+    int idx = (int)((double)value / max * (ns - 1));
+    return ramp[idx < ns - 1 ? idx : ns - 1];
+}
+
+char cnt2char(int value, int max_iter) {
+    return terminal_glyph(DEFAULT_SYMBOLS, sizeof(DEFAULT_SYMBOLS) - 1, value, max_iter);
+}
+
+// The glyph of every value in [0, max] for config's ramp; NULL when the table would be too big
+static char *glyph_table(const Config *config, int max) {
+    if (max >= GLYPH_LUT_MAX) {
+        return NULL;
+    }
+    const char *ramp = config->symbols && *config->symbols ? config->symbols : DEFAULT_SYMBOLS;
+    int ns = (int)strlen(ramp);
+    char *glyphs = malloc((size_t)max + 1);
+    if (!glyphs) {
+        perror("Failed to allocate glyph table");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v <= max; ++v) {
+        glyphs[v] = terminal_glyph(ramp, ns, v, max);
+    }
+    return glyphs;
+}
+
+// format is written as text lines (everything but the binary images)
+static bool text_format(OutputFormat format) {
+    return format == FORMAT_ASCII || format == FORMAT_TEXT || format == FORMAT_HALF ||
+           format == FORMAT_ANSI;
+}
+
+void output_begin(OutputWriter *w, const Config *config, FILE *out) {
+    *w = (OutputWriter){.config = config, .out = out, .bytes = config_output_bytes(config)};
+
+    if (config_rgb(config)) {
+        // Coloured by the render workers
+        image_begin_rgb(&w->image, out, config->format, config->width, config->height);
+        return;
+    }
+    if (!text_format(config->format)) {
+        // Binary image, written straight from the iteration buffer
+        image_begin(&w->image, out, config->format, config->width, config->height,
+                    config_value_max(config));
+        return;
+    }
+
+    int max = config_value_max(config) > 0 ? config_value_max(config) : 1;
+    if (config->format == FORMAT_ASCII || config->format == FORMAT_ANSI) {
+        w->glyphs = glyph_table(config, max);
+    }
+    if (config->format == FORMAT_HALF || config->format == FORMAT_ANSI) {
+        w->colours = colour_map_create(config->palette != PALETTE_NONE ? config->palette
+                                                                      : PALETTE_GREY, max);
+        w->rgb = malloc((size_t)6 * config->width);
+        if (!w->rgb) {
+            perror("Failed to allocate output buffer");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Calculate buffer size for one row:
+    // Digits of the largest value + 2 chars (", ") per pixel, or one full
+    // colour escape plus a glyph per cell (half/ansi). Add padding.
+    int digits = 1;
+    for (int m = max; m >= 10; m /= 10) {
+        ++digits;
+    }
+    size_t cell = w->colours ? sizeof("\x1b[38;2;255;255;255;48;2;255;255;255m\u2580")
+                             : (size_t)digits + 2;
+    size_t row_buffer_size = (size_t)config->width * cell + 64;
+
+    w->text_size = row_buffer_size;
+    w->text = malloc(row_buffer_size);
+    pthread_once(&text_cells_once, text_cells_init);
+    if (!w->text) {
+        perror("Failed to allocate output buffer");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Appends the decimal digits of v (0 to 255)
+static inline char *put_u8(char *ptr, int v) {
+    if (v >= 100) *ptr++ = '0' + v / 100;
+    if (v >= 10) *ptr++ = '0' + v / 10 % 10;
+    *ptr++ = '0' + v % 10;
+    return ptr;
+}
+
+// Appends the SGR parameters "38;2;r;g;b" (fg) or "48;2;r;g;b" (bg)
+static inline char *put_rgb(char *ptr, char plane, const uint8_t *rgb) {
+    *ptr++ = plane;
+    *ptr++ = '8';
+    *ptr++ = ';';
+    *ptr++ = '2';
+    for (int c = 0; c < 3; ++c) {
+        *ptr++ = ';';
+        ptr = put_u8(ptr, rgb[c]);
+    }
+    return ptr;
+}
+
+/*
+ * format=half: one line of upper half blocks, the foreground coloured by
+ * the upper row and the background by the lower one (NULL: the last line of
+ * an odd height, on the terminal's own background). Escapes are only
+ * written where a colour changes.
+ */
+static char *format_half(OutputWriter *w, const uint8_t *upper, const uint8_t *lower) {
+    char *ptr = w->text;
+    for (int x = 0; x < w->config->width; ++x) {
+        const uint8_t *fg = upper + 3 * x;
+        const uint8_t *bg = lower ? lower + 3 * x : NULL;
+        bool same_fg = x > 0 && memcmp(fg, fg - 3, 3) == 0;
+        bool same_bg = x > 0 && (!bg || memcmp(bg, bg - 3, 3) == 0);
+        if (!same_fg || !same_bg) {
+            *ptr++ = '\x1b';
+            *ptr++ = '[';
+            ptr = put_rgb(ptr, '3', fg);
+            *ptr++ = ';';
+            if (bg) {
+                ptr = put_rgb(ptr, '4', bg);
+            } else {
+                *ptr++ = '4';
+                *ptr++ = '9';
+            }
+            *ptr++ = 'm';
+        }
+        memcpy(ptr, "\u2580", 3); // UPPER HALF BLOCK in UTF-8
+        ptr += 3;
+    }
+    memcpy(ptr, "\x1b[0m", 4);
+    return ptr + 4;
+}
+
+// Appends the decimal digits of v, two at a time from the pair table
+static inline char *put_decimal(char *ptr, uint32_t v) {
+    int n = 1;
+    for (uint32_t t = v; t >= 10; t /= 10) {
+        ++n;
+    }
+    char *p = ptr + n;
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (v % 100), 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        memcpy(p - 2, digit_pairs + 2 * v, 2);
+    } else {
+        p[-1] = '0' + v;
+    }
+    return ptr + n;
+}
+
+// Appends ", " and the value; writes up to 8 bytes past the cell for values below TEXT_LUT_MAX
+static inline __attribute__((always_inline)) char *put_text_cell(char *ptr, uint32_t v) {
+    if (v < TEXT_LUT_MAX) {
+        memcpy(ptr, text_cells[v], 8);
+        return ptr + text_cell_len[v];
+    }
+    *ptr++ = ',';
+    *ptr++ = ' ';
+    return put_decimal(ptr, v);
+}
+
+// Formats one ascii/text/ansi row at ptr; inlined once per element width
+static inline __attribute__((always_inline))
+char *format_row(const OutputWriter *w, const void *row_start, int bytes, char *ptr) {
+    const Config *config = w->config;
+
+    if (config->format == FORMAT_TEXT) {
+        // Gnuplot output: the first value alone, then ", value" cells
+        if (config->width > 0) {
+            ptr = put_decimal(ptr, (uint32_t)load_iter(row_start, 0, bytes));
+        }
+        for (int x = 1; x < config->width; ++x) {
+            ptr = put_text_cell(ptr, (uint32_t)load_iter(row_start, x, bytes));
+        }
+    } else if (config->format == FORMAT_ANSI) {
+        // Glyphs in the palette colour of their value
+        colour_row(w->colours, row_start, config->width, bytes, w->rgb);
+        const char *ramp = config->symbols && *config->symbols ? config->symbols : DEFAULT_SYMBOLS;
+        int ns = (int)strlen(ramp), max = w->colours->value_max;
+        for (int x = 0; x < config->width; ++x) {
+            const uint8_t *fg = w->rgb + 3 * x;
+            if (x == 0 || memcmp(fg, fg - 3, 3) != 0) {
+                *ptr++ = '\x1b';
+                *ptr++ = '[';
+                ptr = put_rgb(ptr, '3', fg);
+                *ptr++ = 'm';
+            }
+            int iter = load_iter(row_start, x, bytes);
+            *ptr++ = w->glyphs ? w->glyphs[iter] : terminal_glyph(ramp, ns, iter, max);
+        }
+        memcpy(ptr, "\x1b[0m", 4);
+        ptr += 4;
+    } else if (w->glyphs) {
+        for (int x = 0; x < config->width; ++x) {
+            *ptr++ = w->glyphs[load_iter(row_start, x, bytes)];
+        }
+    } else {
+        const char *ramp = config->symbols && *config->symbols ? config->symbols : DEFAULT_SYMBOLS;
+        int ns = (int)strlen(ramp), max = config_value_max(config);
+        for (int x = 0; x < config->width; ++x) {
+            *ptr++ = terminal_glyph(ramp, ns, load_iter(row_start, x, bytes), max);
+        }
+    }
+    return ptr;
+}
+
+void output_row(OutputWriter *w, const void *row_start) {
+    const Config *config = w->config;
+    char *ptr;
+
+    if (!text_format(config->format)) {
+        image_write_row(&w->image, row_start, w->bytes);
+        return;
+    }
+    if (config->format == FORMAT_HALF) {
+        // Two image rows per line: hold the upper one until the lower arrives
+        if (!w->has_pending) {
+            colour_row(w->colours, row_start, config->width, w->bytes, w->rgb);
+            w->has_pending = true;
+            return;
+        }
+        colour_row(w->colours, row_start, config->width, w->bytes, w->rgb + 3 * config->width);
+        w->has_pending = false;
+        ptr = format_half(w, w->rgb, w->rgb + 3 * config->width);
+    } else {
+        switch (w->bytes) {
+        case 1: ptr = format_row(w, row_start, 1, w->text); break;
+        case 2: ptr = format_row(w, row_start, 2, w->text); break;
+        default: ptr = format_row(w, row_start, 4, w->text); break;
+        }
+    }
+    *ptr++ = '\n';
+    fwrite(w->text, 1, ptr - w->text, w->out);
+}
+
+void output_end(OutputWriter *w) {
+    if (w->has_pending) {
+        // Odd height: the last row gets a line of its own
+        char *ptr = format_half(w, w->rgb, NULL);
+        *ptr++ = '\n';
+        fwrite(w->text, 1, ptr - w->text, w->out);
+    }
+    if (w->text) {
+        free(w->text);
+        free(w->glyphs);
+        free(w->rgb);
+        colour_map_free(w->colours);
+    } else {
+        image_end(&w->image);
+    }
+}
+
+typedef struct {
+    int band;    // The band whose text this slot holds; -1 = none yet
+    char *text;  // TEXT_BAND_ROWS * text_len bytes
+    size_t len;
+} TextBand;
+
+/*
+ * The parallel text formatter: helper threads created once and parked
+ * between frames, with one ring of band buffers reused by every frame.
+ * Helpers claim bands in order while the writing thread writes them, at
+ * most nslots bands ahead of it. frame_lock lets one frame use it at a
+ * time; the rest is under lock.
+ */
+typedef struct {
+    pthread_mutex_t frame_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t start; // A band can be claimed
+    pthread_cond_t done;  // A band has been formatted
+    int nhelpers;
+    TextBand *slots;
+    int nslots;
+    size_t text_len;      // Bytes per row of every slot
+    const OutputWriter *w; // The frame being written
+    const char *buffer;
+    size_t stride;
+    int nbands, next, written;
+} TextFormatter;
+
+static TextFormatter formatter = {
+    .frame_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+// Formats output rows [r0, r1) of the formatter's frame into text; returns the length
+static size_t format_band(const TextFormatter *f, int r0, int r1, char *text) {
+    const OutputWriter *w = f->w;
+    const Config *config = w->config;
+    char *ptr = text;
+
+    for (int r = r0; r < r1; ++r) {
+        int y = config->format == FORMAT_TEXT ? config->height - 1 - r : r;
+        const void *row = f->buffer + y * f->stride;
+        switch (w->bytes) {
+        case 1: ptr = format_row(w, row, 1, ptr); break;
+        case 2: ptr = format_row(w, row, 2, ptr); break;
+        default: ptr = format_row(w, row, 4, ptr); break;
+        }
+        *ptr++ = '\n';
+    }
+    return ptr - text;
+}
+
+// Formatter helper: formats the bands it claims, for every frame until exit
+static void *formatter_main(void *arg) {
+    TextFormatter *f = arg;
+    pthread_mutex_lock(&f->lock);
+    for (;;) {
+        while (!(f->next < f->nbands && f->next < f->written + f->nslots)) {
+            pthread_cond_wait(&f->start, &f->lock);
+        }
+        int band = f->next++;
+        TextBand *slot = &f->slots[band % f->nslots];
+        int height = f->w->config->height;
+        int r0 = band * TEXT_BAND_ROWS;
+        int r1 = r0 + TEXT_BAND_ROWS < height ? r0 + TEXT_BAND_ROWS : height;
+        pthread_mutex_unlock(&f->lock);
+
+        size_t len = format_band(f, r0, r1, slot->text);
+
+        pthread_mutex_lock(&f->lock);
+        slot->len = len;
+        slot->band = band;
+        pthread_cond_broadcast(&f->done);
+    }
+    return NULL;
+}
+
+// Grows the formatter to helpers threads and slots band buffers; no frame is in flight
+static void formatter_reserve(TextFormatter *f, int helpers, int slots, size_t text_len) {
+    if (slots > f->nslots || text_len > f->text_len) {
+        for (int i = 0; i < f->nslots; ++i) {
+            free(f->slots[i].text);
+        }
+        free(f->slots);
+        int nslots = slots > f->nslots ? slots : f->nslots;
+        size_t len = text_len > f->text_len ? text_len : f->text_len;
+        f->slots = calloc(nslots, sizeof(TextBand));
+        if (!f->slots) {
+            perror("Failed to allocate text bands");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < nslots; ++i) {
+            f->slots[i].text = malloc(len * TEXT_BAND_ROWS);
+            if (!f->slots[i].text) {
+                perror("Failed to allocate text bands");
+                exit(EXIT_FAILURE);
+            }
+        }
+        f->nslots = nslots;
+        f->text_len = len;
+    }
+    for (; f->nhelpers < helpers; ++f->nhelpers) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, formatter_main, f) != 0) {
+            perror("Failed to create formatter thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(tid);
+    }
+}
+
+/**
+ * @brief ascii/text frames on threads threads: bands of TEXT_BAND_ROWS rows.
+ *
+ * threads - 1 helpers of the persistent formatter format the bands while
+ * the calling thread writes them in order, so the output is byte-identical
+ * to the single-threaded writer. The helpers and buffers are kept for the
+ * next frame.
+ */
+static void write_text_parallel(const OutputWriter *w, const void *buffer, size_t stride,
+                                int threads) {
+    TextFormatter *f = &formatter;
+    pthread_mutex_lock(&f->frame_lock);
+    pthread_mutex_lock(&f->lock);
+    formatter_reserve(f, threads - 1, 2 * threads, w->text_size);
+    for (int i = 0; i < f->nslots; ++i) {
+        f->slots[i].band = -1;
+    }
+    f->w = w;
+    f->buffer = buffer;
+    f->stride = stride;
+    f->nbands = (w->config->height + TEXT_BAND_ROWS - 1) / TEXT_BAND_ROWS;
+    f->next = 0;
+    f->written = 0;
+    pthread_cond_broadcast(&f->start);
+
+    for (int band = 0; band < f->nbands; ++band) {
+        TextBand *slot = &f->slots[band % f->nslots];
+        while (slot->band != band) {
+            pthread_cond_wait(&f->done, &f->lock);
+        }
+        pthread_mutex_unlock(&f->lock);
+        fwrite(slot->text, 1, slot->len, w->out);
+        pthread_mutex_lock(&f->lock);
+        f->written = band + 1;
+        pthread_cond_broadcast(&f->start);
+    }
+    f->nbands = 0;
+    pthread_mutex_unlock(&f->lock);
+    pthread_mutex_unlock(&f->frame_lock);
+}
+
+void write_frame(const Config *config, const void *buffer, size_t stride, FILE *out) {
+    OutputWriter writer;
+    output_begin(&writer, config, out);
+    if ((config->format == FORMAT_TEXT || config->format == FORMAT_ASCII) && config->threads > 1 &&
+        config->height > TEXT_BAND_ROWS) {
+        write_text_parallel(&writer, buffer, stride, config->threads);
+        output_end(&writer);
+        return;
+    }
+    for (int r = 0; r < config->height; ++r) {
+        // The gnuplot matrix is written bottom row first; everything else top first
+        int y = config->format == FORMAT_TEXT ? config->height - 1 - r : r;
+        output_row(&writer, (const char *)buffer + y * stride);
+    }
+    output_end(&writer);
+}
+
+bool mapped_output_open(MappedOutput *m, const Config *config, const char *path) {
+    OutputFormat format = config->format;
+    if (format == FORMAT_PNG || format == FORMAT_HALF || format == FORMAT_ANSI) {
+        return false;
+    }
+    *m = (MappedOutput){.config = config, .fd = -1};
+    int max = config_value_max(config) > 0 ? config_value_max(config) : 1;
+
+    char header[IMAGE_HEADER_MAX];
+    if (format == FORMAT_ASCII) {
+        m->glyphs = glyph_table(config, max);
+        m->row_bytes = (size_t)config->width + 1;
+    } else if (format == FORMAT_TEXT) {
+        m->field = 1;
+        for (int v = max; v >= 10; v /= 10) {
+            m->field++;
+        }
+        // Fields, ", " between them, newline
+        m->row_bytes = config->width > 0 ? (size_t)config->width * (m->field + 2) - 1 : 1;
+    } else {
+        m->header = image_layout(&m->image, format, config->width, config->height, max,
+                                 config_rgb(config), header);
+        m->row_bytes = m->image.stride - 1;
+    }
+    m->size = m->header + m->row_bytes * config->height;
+
+    m->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (m->fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    // Reserve the blocks up front where the file system can; a sparse file otherwise
+    int err = posix_fallocate(m->fd, 0, (off_t)m->size);
+    if (err != 0 && ftruncate(m->fd, (off_t)m->size) != 0) {
+        errno = err;
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (m->size > 0) {
+        m->map = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+        if (m->map == MAP_FAILED) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(m->map, header, m->header);
+    }
+    return true;
+}
+
+// Writes v right-aligned in field characters
+static inline char *put_field(char *ptr, int v, int field) {
+    char *end = ptr + field;
+    char *p = end;
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v && p > ptr);
+    while (p > ptr) {
+        *--p = ' ';
+    }
+    return end;
+}
+
+// Formats one row into its place in the file; inlined once per element width
+static inline __attribute__((always_inline))
+void mapped_row(const MappedOutput *m, const void *row, int bytes, char *dest) {
+    const Config *config = m->config;
+
+    if (config->format == FORMAT_TEXT) {
+        char *ptr = dest;
+        for (int x = 0; x < config->width; ++x) {
+            if (x > 0) {
+                *ptr++ = ',';
+                *ptr++ = ' ';
+            }
+            ptr = put_field(ptr, load_iter(row, x, bytes), m->field);
+        }
+        dest[m->row_bytes - 1] = '\n';
+    } else if (config->format == FORMAT_ASCII) {
+        int max = config_value_max(config);
+        for (int x = 0; x < config->width; ++x) {
+            int value = load_iter(row, x, bytes);
+            dest[x] = m->glyphs ? m->glyphs[value] : cnt2char(value, max);
+        }
+        dest[m->row_bytes - 1] = '\n';
+    } else {
+        image_pack(&m->image, row, bytes, (uint8_t *)dest);
+    }
+}
+
+void mapped_output_rows(void *ctx, int y_lo, int rows, const void *data, size_t stride) {
+    const MappedOutput *m = ctx;
+    const Config *config = m->config;
+    int bytes = config_output_bytes(config);
+
+    for (int r = 0; r < rows; ++r) {
+        const void *row = (const char *)data + r * stride;
+        // The gnuplot matrix is stored bottom row first
+        int y = y_lo + r;
+        size_t line = config->format == FORMAT_TEXT ? (size_t)(config->height - 1 - y) : (size_t)y;
+        char *dest = m->map + m->header + line * m->row_bytes;
+        switch (bytes) {
+        case 1: mapped_row(m, row, 1, dest); break;
+        case 2: mapped_row(m, row, 2, dest); break;
+        default: mapped_row(m, row, 4, dest); break;
+        }
+    }
+}
+
+void mapped_output_close(MappedOutput *m) {
+    if (m->map && munmap(m->map, m->size) != 0) {
+        perror("Failed to write mapped output");
+        exit(EXIT_FAILURE);
+    }
+    if (close(m->fd) != 0) {
+        perror("Failed to write mapped output");
+        exit(EXIT_FAILURE);
+    }
+    free(m->glyphs);
+}
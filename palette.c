@@ -0,0 +1,117 @@
+/**
+ * @file palette.c
+ * @brief palette= gradients and their lookup tables; see palette.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "palette.h"
+
+typedef struct {
+    double at; // Position in [0, 1]: the fraction of max_iter iterations the point ran
+    uint8_t r, g, b;
+} ColourStop;
+
+/*
+ * Gradients from points that escape at once (0) to points that run all
+ * max_iter iterations (1). Points inside the set are black in every palette;
+ * grey matches topng.gp (white far from the set).
+ */
+static const ColourStop grey_stops[] = {
+    {0.0, 255, 255, 255}, {1.0, 0, 0, 0}
+};
+static const ColourStop fire_stops[] = {
+    {0.0, 0, 0, 0}, {0.2, 180, 20, 0}, {0.5, 255, 160, 0}, {0.8, 255, 255, 120},
+    {1.0, 255, 255, 255}
+};
+static const ColourStop ocean_stops[] = {
+    {0.0, 0, 0, 20}, {0.25, 0, 40, 140}, {0.6, 0, 170, 220}, {1.0, 230, 255, 255}
+};
+static const ColourStop rainbow_stops[] = {
+    {0.0, 255, 0, 0}, {1.0 / 6, 255, 255, 0}, {2.0 / 6, 0, 255, 0}, {3.0 / 6, 0, 255, 255},
+    {4.0 / 6, 0, 0, 255}, {5.0 / 6, 255, 0, 255}, {1.0, 255, 0, 0}
+};
+
+// Linear interpolation between the stops around t
+static void gradient(const ColourStop *stops, int nstops, double t, uint8_t *rgb) {
+    int i = 1;
+    while (i < nstops - 1 && stops[i].at < t) {
+        ++i;
+    }
+    const ColourStop *a = &stops[i - 1], *b = &stops[i];
+    double f = b->at > a->at ? (t - a->at) / (b->at - a->at) : 0.0;
+    f = f < 0.0 ? 0.0 : f > 1.0 ? 1.0 : f;
+    rgb[0] = (uint8_t)(a->r + (b->r - a->r) * f + 0.5);
+    rgb[1] = (uint8_t)(a->g + (b->g - a->g) * f + 0.5);
+    rgb[2] = (uint8_t)(a->b + (b->b - a->b) * f + 0.5);
+}
+
+#define STOPS(name) {name, sizeof(name) / sizeof(*name)}
+
+static const struct {
+    const ColourStop *stops;
+    int nstops;
+} gradients[] = {
+    [PALETTE_GREY] = STOPS(grey_stops),
+    [PALETTE_FIRE] = STOPS(fire_stops),
+    [PALETTE_OCEAN] = STOPS(ocean_stops),
+    [PALETTE_RAINBOW] = STOPS(rainbow_stops)
+};
+
+ColourMap *colour_map_create(Palette palette, int value_max) {
+    const ColourStop *stops = gradients[palette].stops;
+    int nstops = gradients[palette].nstops;
+
+    ColourMap *map = malloc(sizeof(ColourMap));
+    int max = value_max > 0 ? value_max : 1;
+    int entries = max < COLOUR_LUT_MAX ? max + 1 : COLOUR_LUT_MAX;
+    uint8_t *rgb = malloc((size_t)3 * entries);
+    if (!map || !rgb) {
+        perror("Failed to allocate colour table");
+        exit(EXIT_FAILURE);
+    }
+    *map = (ColourMap){.palette = palette, .value_max = max, .entries = entries, .rgb = rgb};
+
+    memset(rgb, 0, 3); // value 0: inside the set
+    for (int i = 1; i < entries; ++i) {
+        double value = entries == max + 1 ? i : (double)i * max / (entries - 1);
+        gradient(stops, nstops, 1.0 - value / max, rgb + 3 * i);
+    }
+    return map;
+}
+
+void colour_map_free(ColourMap *map) {
+    if (map) {
+        free(map->rgb);
+        free(map);
+    }
+}
+
+// The row loop, inlined once per element width
+static inline __attribute__((always_inline))
+void colour_values(const ColourMap *map, const void *values, int n, int bytes, uint8_t *rgb) {
+    const uint8_t *lut = map->rgb;
+    if (map->entries == map->value_max + 1) {
+        for (int i = 0; i < n; ++i) {
+            memcpy(rgb + 3 * i, lut + 3 * load_iter(values, i, bytes), 3);
+        }
+    } else {
+        uint64_t last = (uint64_t)map->entries - 1;
+        for (int i = 0; i < n; ++i) {
+            uint64_t idx = (uint64_t)(uint32_t)load_iter(values, i, bytes) * last / map->value_max;
+            memcpy(rgb + 3 * i, lut + 3 * idx, 3);
+        }
+    }
+}
+
+void colour_row(const ColourMap *map, const void *values, int n, int bytes, uint8_t *rgb) {
+    switch (bytes) {
+    case 1: colour_values(map, values, n, 1, rgb); break;
+    case 2: colour_values(map, values, n, 2, rgb); break;
+    default: colour_values(map, values, n, 4, rgb); break;
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * @file palette.h
+ * @brief palette= colour lookup tables, internal to libmandelbrot.
+ *
+ * A ColourMap holds one RGB triple per value a render buffer can contain
+ * (256 entries at max_iter 255, 65536 with smooth=1), so colouring a pixel
+ * is a single table load. Render workers colour each row right after its
+ * kernel has written it (see render.c).
+ */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mandelbrot.h"
+
+#define COLOUR_LUT_MAX 65536 // Entries at most; larger value ranges are scaled down onto them
+
+struct ColourMap {
+    Palette palette;
+    int value_max; // The value mapped to the last entry
+    int entries;   // value_max + 1, at most COLOUR_LUT_MAX
+    uint8_t *rgb;  // entries RGB triples
+};
+
+/**
+ * @brief Builds the table of palette over the values [0, value_max].
+ * @param palette A palette other than PALETTE_NONE.
+ * @param value_max The largest value (config_value_max()).
+ * @return The map; exits on failure.
+ */
+ColourMap *colour_map_create(Palette palette, int value_max);
+
+void colour_map_free(ColourMap *map);
+
+/**
+ * @brief Colours n values into n RGB triples.
+ * @param map The map.
+ * @param values The values, bytes each (1, 2 or 4).
+ * @param n The number of values.
+ * @param bytes The element width of values.
+ * @param rgb Receives 3 * n bytes.
+ */
+void colour_row(const ColourMap *map, const void *values, int n, int bytes, uint8_t *rgb);
+
+#endif // PALETTE_H
@@ -0,0 +1,2652 @@
+/**
+ * @file render.c
+ * @brief libmandelbrot render engine: kernels, schedulers and render().
+ *
+ * Everything a render needs lives in the Config copy, the scheduler and the
+ * ThreadArgs of that call, so independent renders can run concurrently.
+ * Workers belong to a RenderPool: render() and render_bands() start one for
+ * the call, render_pool_frame() reuses one across frames.
+ */
+
+#define _GNU_SOURCE // pthread_setaffinity_np(), sched_getaffinity(), MAP_ANONYMOUS under -std=c23
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mandelbrot.h"
+#include "bench.h"
+#include "gpu.h"
+#include "palette.h"
+#include "histogram.h"
+
+#define CHUNK_TARGET_WORK (1 << 20) // Pixel-iterations per task aimed for by chunk auto-tuning
+#define TASKS_PER_THREAD  4         // Minimum tasks per thread the auto-tuner leaves for load balance
+#define SIMD_LANES        8         // Pixels per vector kernel call (one AVX-512 register, two AVX2/four NEON)
+#define CACHE_LINE        64
+#define PERIOD_EPS        1e-14     // Orbit points closer than this to the saved point count as a cycle
+#define MARIANI_MIN       6         // Rectangles this narrow are computed pixel by pixel
+#define FIXED_LIMBS_MAX   32        // 32-bit limbs for perturbation reference orbits (~990 fraction bits)
+#define FLOAT_LANES       (2 * SIMD_LANES) // Pixels per float kernel call, same register width
+#define PERIOD_EPS_FLOAT  4e-6f     // PERIOD_EPS for precision=float (~20 ulps at |z| = 2)
+#define PERIOD_EPS_LONG   1e-17L    // PERIOD_EPS for precision=long
+#define PRECISION_MARGIN  4096.0    // auto: pixel spacing must span this many ulps of the view
+#define AA_RUN            64        // aa=: edge pixels supersampled per kernel call
+#define ESCAPE_UNROLL     8         // Lane kernel steps between escape checks (unroll=1)
+#define PAN_TOLERANCE     1e-3      // render_pool_pan(): largest distance from a whole-pixel shift, in pixels
+
+typedef double vdouble __attribute__((vector_size(SIMD_LANES * sizeof(double))));
+typedef int64_t vmask __attribute__((vector_size(SIMD_LANES * sizeof(int64_t))));
+typedef float vfloat __attribute__((vector_size(FLOAT_LANES * sizeof(float))));
+typedef int32_t vmask32 __attribute__((vector_size(FLOAT_LANES * sizeof(int32_t))));
+
+struct PerturbOrbit {
+    double *zr; // Reference orbit Z_0..Z_{len-1}, rounded to double
+    double *zi;
+    int len;
+    double fwidth;  // View size; exact enough in double at any zoom
+    double fheight;
+};
+
+typedef struct {
+    long long tasks;      // Tiles, row chunks or bands rendered
+    long long rows;       // Block rows rendered (tile rows count once per tile)
+    long long pixels;
+    long long steals;     // Successful tile_steal() calls
+    double busy;          // Seconds inside render_block()
+    double last;          // End of the last task, seconds since the frame started
+} WorkerStats;
+
+// Computes iteration values for pixels x_start, x_start + x_step, ... < x_end of row y into out[0..]
+typedef void (*row_kernel_fn)(const Config *config, int y, int x_start, int x_end, void *out,
+                              KernelStats *stats);
+
+// Smallest element width that holds every value in [0, config_value_max()]
+int config_pixel_bytes(const Config *config) {
+    int max = config_value_max(config);
+    return max <= UINT8_MAX ? 1 : max <= UINT16_MAX ? 2 : 4;
+}
+
+int config_value_max(const Config *config) {
+    return config->smooth ? SMOOTH_ONE : config->max_iter;
+}
+
+bool config_rgb(const Config *config) {
+    return config->palette != PALETTE_NONE &&
+           (config->format == FORMAT_PNG || config->format == FORMAT_PPM);
+}
+
+int config_output_bytes(const Config *config) {
+    return config_rgb(config) ? 3 : config_pixel_bytes(config);
+}
+
+/**
+ * @brief smooth=1: the stored value of a pixel, from the escape loop's own exit state.
+ *
+ * Uses the log-log continuous count mu = iter + 1 - log2(log |z|), so no
+ * second pass over the orbit is needed, and maps max_iter - mu from
+ * [0, max_iter] to [0, SMOOTH_ONE].
+ * @param iter Iterations run; max_iter for points that did not escape.
+ * @param mag |z|^2 at escape.
+ * @param max_iter The maximum number of iterations.
+ * @return The fixed-point value; 0 inside the set.
+ */
+static inline int smooth_value(int iter, double mag, int max_iter) {
+    if (iter >= max_iter) {
+        return 0;
+    }
+    double mu = iter + 1 - log2(0.5 * log(mag));
+    double v = (max_iter - mu) / max_iter;
+    v = v < 0.0 ? 0.0 : v > 1.0 ? 1.0 : v;
+    return (int)(v * SMOOTH_ONE + 0.5);
+}
+
+// Defines NAME_u8/_u16/_u32 row kernels that call IMPL with a constant width
+#define ROW_KERNEL_WIDTHS(NAME, IMPL, ...)                                                     \
+    __VA_ARGS__ static void NAME##_u8(const Config *config, int y, int x_start, int x_end,     \
+                                      void *out, KernelStats *stats) {                        \
+        IMPL(config, y, x_start, x_end, out, stats, 1);                                        \
+    }                                                                                          \
+    __VA_ARGS__ static void NAME##_u16(const Config *config, int y, int x_start, int x_end,    \
+                                       void *out, KernelStats *stats) {                       \
+        IMPL(config, y, x_start, x_end, out, stats, 2);                                        \
+    }                                                                                          \
+    __VA_ARGS__ static void NAME##_u32(const Config *config, int y, int x_start, int x_end,    \
+                                       void *out, KernelStats *stats) {                       \
+        IMPL(config, y, x_start, x_end, out, stats, 4);                                        \
+    }
+
+#define ROW_KERNEL_FOR(NAME, bytes) ((bytes) == 1 ? NAME##_u8 : (bytes) == 2 ? NAME##_u16 : NAME##_u32)
+
+int escape_time(double cr, double ci, int max_iter) {
+    double zr = 0.0, zi = 0.0;
+    int iter;
+
+    for (iter = 0; iter < max_iter; ++iter) {
+        double zr2 = zr * zr;
+        double zi2 = zi * zi;
+        if (zr2 + zi2 > 4.0) {
+            break;
+        }
+        double tmp = zr2 - zi2 + cr;
+        zi = 2.0 * zr * zi + ci;
+        zr = tmp;
+    }
+    return max_iter - iter;
+}
+
+/**
+ * @brief escape_time() with Brent-style periodicity checking.
+ *
+ * The orbit is compared against a saved point that is refreshed at
+ * power-of-two iterations. Once the orbit returns to within PERIOD_EPS of it,
+ * the orbit is bounded, and the point is reported as in the set without
+ * running to max_iter.
+ * @param cr The real part of the complex number c.
+ * @param ci The imaginary part of the complex number c.
+ * @param max_iter The maximum number of iterations.
+ * @param periodic Set to true if the loop exited on a detected cycle.
+ * @param passes Receives the number of loop passes run.
+ * @return An integer representing how close the point is to the set.
+ */
+static inline int escape_time_periodic(double cr, double ci, int max_iter, bool *periodic,
+                                       int *passes) {
+    double zr = 0.0, zi = 0.0;
+    double sr = 0.0, si = 0.0; // saved orbit point
+    int next_save = 1;
+    int iter;
+
+    *periodic = false;
+    for (iter = 0; iter < max_iter; ++iter) {
+        double zr2 = zr * zr;
+        double zi2 = zi * zi;
+        if (zr2 + zi2 > 4.0) {
+            break;
+        }
+        double tmp = zr2 - zi2 + cr;
+        zi = 2.0 * zr * zi + ci;
+        zr = tmp;
+
+        double dr = zr - sr, di = zi - si;
+        if (dr * dr + di * di < PERIOD_EPS * PERIOD_EPS) {
+            *periodic = true;
+            *passes = iter + 1;
+            return 0;
+        }
+        if (iter + 1 == next_save) {
+            sr = zr;
+            si = zi;
+            next_save *= 2;
+        }
+    }
+    *passes = iter;
+    return max_iter - iter;
+}
+
+/**
+ * @brief Closed-form test for the main cardioid and the period-2 bulb.
+ *
+ * Points inside either region never escape, so escape_time() would run the
+ * full max_iter loop for them.
+ * @param cr The real part of the complex number c.
+ * @param ci The imaginary part of the complex number c.
+ * @return true if c is known to be in the set.
+ */
+static inline bool in_main_bulbs(double cr, double ci) {
+    double ci2 = ci * ci;
+    double xr = cr - 0.25;
+    double q = xr * xr + ci2;
+    if (q * (q + xr) <= 0.25 * ci2) {
+        return true; // main cardioid
+    }
+    double xb = cr + 1.0;
+    return xb * xb + ci2 <= 0.0625; // period-2 bulb, radius 1/4 around -1
+}
+
+/**
+ * @brief Scalar reference row kernel - one escape_time() call per pixel.
+ * @param config A pointer to the configuration struct.
+ * @param y The row index (maps to imag = ur_y - y * fheight / height).
+ * @param x_start The first column to compute.
+ * @param x_end One past the last column to compute.
+ * @param out Receives one iteration value per column computed: x_start and
+ *        every config->x_step-th column after it, up to x_end.
+ * @param stats Accumulates kernel counters.
+ * @param bytes The width of each element of out.
+ */
+static inline __attribute__((always_inline))
+void escape_row_scalar(const Config *config, int y, int x_start, int x_end, void *out,
+                       KernelStats *stats, int bytes) {
+    double fwidth = config->ur_x - config->ll_x;
+    double fheight = config->ur_y - config->ll_y;
+    double imag = config->ur_y - y * fheight / config->height;
+
+    for (int x = x_start, i = 0; x < x_end; x += config->x_step, ++i) {
+        double real = config->ll_x + x * fwidth / config->width;
+        int iter;
+        if (config->interior && in_main_bulbs(real, imag)) {
+            iter = 0;
+        } else if (config->period) {
+            bool periodic;
+            int passes;
+            iter = escape_time_periodic(real, imag, config->max_iter, &periodic, &passes);
+            stats->periodic += periodic;
+            stats->iterations += passes;
+        } else {
+            iter = escape_time(real, imag, config->max_iter);
+            stats->iterations += config->max_iter - iter;
+        }
+        store_iter(out, i, iter, bytes);
+    }
+}
+
+/**
+ * @brief Iterates SIMD_LANES points of one row at once.
+ *
+ * Same recurrence as escape_time(), but each lane carries its own escape
+ * mask. Escaped lanes keep iterating (their values are masked out of the
+ * count) until every lane has escaped or max_iter is reached. With period
+ * set, lanes whose orbit hits the shared Brent checkpoint schedule of
+ * escape_time_periodic() are retired as in the set.
+ * @param cr The real parts, one per lane.
+ * @param ci The shared imaginary part of the row.
+ * @param max_iter The maximum number of iterations.
+ * @param interior Start lanes inside in_main_bulbs() as already finished.
+ * @param period Enable periodicity checking.
+ * @param unroll Without period, test whether any lane is still active only
+ * every ESCAPE_UNROLL steps; the counts are unchanged.
+ * @param out Receives one iteration value per lane.
+ * @param escape_mag Receives |z|^2 at escape per lane (smooth=1), or NULL.
+ * @param passes Receives the number of vector loop passes run.
+ * @return A bit mask of the lanes that exited on a detected cycle.
+ */
+static inline __attribute__((always_inline))
+unsigned escape_time_lanes(const double *cr, double ci, int max_iter, bool interior, bool period,
+                           bool unroll, int *out, double *escape_mag, int *passes) {
+    vdouble zr = {0}, zi = {0}, vcr;
+    memcpy(&vcr, cr, sizeof(vcr));
+    vdouble vci = zr + ci;
+    vdouble four = zr + 4.0;
+    vmask inside = {0};
+
+    if (interior) {
+        vdouble ci2 = vci * vci;
+        vdouble xr = vcr - 0.25;
+        vdouble q = xr * xr + ci2;
+        vdouble xb = vcr + 1.0;
+        inside = (q * (q + xr) <= 0.25 * ci2) | (xb * xb + ci2 <= zr + 0.0625);
+    }
+    vmask active = ~inside;
+    vmask count = inside & (int64_t)max_iter; // inside lanes report 0
+    vmask cycled = {0};
+    vdouble sr = {0}, si = {0}; // saved orbit points
+    vdouble mag = {0};
+    int next_save = 1;
+    int iter;
+    // unroll: test for the exit only every ESCAPE_UNROLL steps; lanes still stop counting at
+    // their own escape, so only the loop's horizontal reduction and branch are skipped
+    int exit_mask = unroll && !period ? ESCAPE_UNROLL - 1 : 0;
+
+    for (iter = 0; iter < max_iter; ++iter) {
+        vdouble zr2 = zr * zr;
+        vdouble zi2 = zi * zi;
+        if (escape_mag) {
+            // Lanes escaping now keep this |z|^2
+            vmask escaping = active & (zr2 + zi2 > four);
+            mag = (vdouble)(((vmask)mag & ~escaping) | ((vmask)(zr2 + zi2) & escaping));
+        }
+        active &= (zr2 + zi2 <= four);
+
+        if ((iter & exit_mask) == 0) {
+            int64_t any = 0;
+            for (int l = 0; l < SIMD_LANES; ++l) {
+                any |= active[l];
+            }
+            if (!any) {
+                break;
+            }
+        }
+
+        count -= active; // active lanes are all ones (-1)
+        vdouble tmp = zr2 - zi2 + vcr;
+        zi = 2.0 * zr * zi + vci;
+        zr = tmp;
+
+        if (period) {
+            vdouble dr = zr - sr, di = zi - si;
+            vmask cycle = active & (dr * dr + di * di < zr * 0.0 + PERIOD_EPS * PERIOD_EPS);
+            count = (count & ~cycle) | (cycle & (int64_t)max_iter);
+            active &= ~cycle;
+            cycled |= cycle;
+            if (iter + 1 == next_save) {
+                sr = zr;
+                si = zi;
+                next_save *= 2;
+            }
+        }
+    }
+
+    unsigned lanes = 0;
+    for (int l = 0; l < SIMD_LANES; ++l) {
+        out[l] = max_iter - (int)count[l];
+        lanes |= (cycled[l] != 0) << l;
+        if (escape_mag) {
+            escape_mag[l] = mag[l];
+        }
+    }
+    *passes = iter;
+    return lanes;
+}
+
+static inline __attribute__((always_inline))
+void escape_row_lanes(const Config *config, int y, int x_start, int x_end, void *out,
+                      KernelStats *stats, int bytes) {
+    double fwidth = config->ur_x - config->ll_x;
+    double fheight = config->ur_y - config->ll_y;
+    double imag = config->ur_y - y * fheight / config->height;
+    int step = config->x_step;
+    int samples = (x_end - x_start + step - 1) / step;
+
+    for (int i = 0; i < samples; i += SIMD_LANES) {
+        double cr[SIMD_LANES];
+        int iter[SIMD_LANES];
+        double mag[SIMD_LANES];
+        // Lanes past x_end are computed but not stored
+        for (int l = 0; l < SIMD_LANES; ++l) {
+            cr[l] = config->ll_x + (x_start + (i + l) * step) * fwidth / config->width;
+        }
+        int passes;
+        unsigned cycled = escape_time_lanes(cr, imag, config->max_iter, config->interior,
+                                            config->period, config->unroll, iter,
+                                            config->smooth ? mag : NULL, &passes);
+
+        int n = samples - i < SIMD_LANES ? samples - i : SIMD_LANES;
+        for (int l = 0; l < n; ++l) {
+            int value = config->smooth ? smooth_value(config->max_iter - iter[l], mag[l],
+                                                      config->max_iter)
+                                       : iter[l];
+            store_iter(out, i + l, value, bytes);
+        }
+        stats->periodic += __builtin_popcount(cycled & ((1u << n) - 1));
+        stats->iterations += (long long)passes * SIMD_LANES;
+    }
+}
+
+_Static_assert(FLOAT_LANES == 16, "any_lane32() folds 16 lanes");
+
+// True if any lane of m is set; folds halves together instead of extracting every lane
+static inline __attribute__((always_inline)) bool any_lane32(vmask32 m) {
+    m |= __builtin_shufflevector(m, m, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    m |= __builtin_shufflevector(m, m, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11);
+    m |= __builtin_shufflevector(m, m, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    m |= __builtin_shufflevector(m, m, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    return m[0] != 0;
+}
+
+/**
+ * @brief escape_time_lanes() in float: FLOAT_LANES points per call.
+ *
+ * For precision=float. Twice the lanes of the double kernel fit the same
+ * registers; the cardioid test and the pixel coordinates stay in double.
+ */
+static inline __attribute__((always_inline))
+unsigned escape_time_lanes_float(const float *cr, float ci, int max_iter, const vmask32 *inside,
+                                 bool period, int *out, float *escape_mag, int *passes) {
+    vfloat zr = {0}, zi = {0}, vcr;
+    memcpy(&vcr, cr, sizeof(vcr));
+    vfloat vci = zr + ci;
+    vfloat four = zr + 4.0f;
+    vmask32 active = ~*inside;
+    vmask32 count = *inside & (int32_t)max_iter; // inside lanes report 0
+    vmask32 cycled = {0};
+    vfloat sr = {0}, si = {0}; // saved orbit points
+    vfloat mag = {0};
+    int next_save = 1;
+    int iter;
+
+    for (iter = 0; iter < max_iter; ++iter) {
+        vfloat zr2 = zr * zr;
+        vfloat zi2 = zi * zi;
+        if (escape_mag) {
+            vmask32 escaping = active & (zr2 + zi2 > four);
+            mag = (vfloat)(((vmask32)mag & ~escaping) | ((vmask32)(zr2 + zi2) & escaping));
+        }
+        active &= (zr2 + zi2 <= four);
+
+        if (!any_lane32(active)) {
+            break;
+        }
+
+        count -= active; // active lanes are all ones (-1)
+        vfloat tmp = zr2 - zi2 + vcr;
+        zi = 2.0f * zr * zi + vci;
+        zr = tmp;
+
+        if (period) {
+            vfloat dr = zr - sr, di = zi - si;
+            vmask32 cycle = active & (dr * dr + di * di < zr * 0.0f + PERIOD_EPS_FLOAT * PERIOD_EPS_FLOAT);
+            count = (count & ~cycle) | (cycle & (int32_t)max_iter);
+            active &= ~cycle;
+            cycled |= cycle;
+            if (iter + 1 == next_save) {
+                sr = zr;
+                si = zi;
+                next_save *= 2;
+            }
+        }
+    }
+
+    unsigned lanes = 0;
+    for (int l = 0; l < FLOAT_LANES; ++l) {
+        out[l] = max_iter - (int)count[l];
+        lanes |= (unsigned)(cycled[l] != 0) << l;
+        if (escape_mag) {
+            escape_mag[l] = mag[l];
+        }
+    }
+    *passes = iter;
+    return lanes;
+}
+
+static inline __attribute__((always_inline))
+void escape_row_lanes_float(const Config *config, int y, int x_start, int x_end, void *out,
+                            KernelStats *stats, int bytes) {
+    double fwidth = config->ur_x - config->ll_x;
+    double fheight = config->ur_y - config->ll_y;
+    double imag = config->ur_y - y * fheight / config->height;
+    int step = config->x_step;
+    int samples = (x_end - x_start + step - 1) / step;
+
+    for (int i = 0; i < samples; i += FLOAT_LANES) {
+        float cr[FLOAT_LANES];
+        vmask32 inside = {0};
+        int iter[FLOAT_LANES];
+        float mag[FLOAT_LANES];
+        // Lanes past x_end are computed but not stored
+        for (int l = 0; l < FLOAT_LANES; ++l) {
+            double real = config->ll_x + (x_start + (i + l) * step) * fwidth / config->width;
+            cr[l] = (float)real;
+            inside[l] = config->interior && in_main_bulbs(real, imag) ? -1 : 0;
+        }
+        int passes;
+        unsigned cycled = escape_time_lanes_float(cr, (float)imag, config->max_iter, &inside,
+                                                  config->period, iter,
+                                                  config->smooth ? mag : NULL, &passes);
+
+        int n = samples - i < FLOAT_LANES ? samples - i : FLOAT_LANES;
+        for (int l = 0; l < n; ++l) {
+            int value = config->smooth ? smooth_value(config->max_iter - iter[l], mag[l],
+                                                      config->max_iter)
+                                       : iter[l];
+            store_iter(out, i + l, value, bytes);
+        }
+        stats->periodic += __builtin_popcount(cycled & ((1u << n) - 1));
+        stats->iterations += (long long)passes * FLOAT_LANES;
+    }
+}
+
+/*
+ * Defines NAME(config, y, x_start, x_end, out, stats, bytes), the scalar
+ * row kernel iterating in floating type T with cycle tolerance EPS, for
+ * the precisions that have no hand-written kernel above and for smooth=1
+ * in double (escape_time() only returns the count). Pixel coordinates
+ * are computed in type C from VIEW(config, field), so long double can
+ * bypass the double fields.
+ */
+#define SCALAR_ROW_KERNEL(NAME, T, C, EPS, VIEW)                                               \
+    static inline __attribute__((always_inline))                                               \
+    void NAME(const Config *config, int y, int x_start, int x_end, void *out,                  \
+              KernelStats *stats, int bytes) {                                                 \
+        C fwidth = VIEW(config, ur_x) - VIEW(config, ll_x);                                    \
+        C fheight = VIEW(config, ur_y) - VIEW(config, ll_y);                                   \
+        T ci = VIEW(config, ur_y) - y * fheight / config->height;                              \
+                                                                                               \
+        for (int x = x_start, i = 0; x < x_end; x += config->x_step, ++i) {                    \
+            T cr = VIEW(config, ll_x) + x * fwidth / config->width;                            \
+            if (config->interior && in_main_bulbs((double)cr, (double)ci)) {                   \
+                store_iter(out, i, 0, bytes);                                                  \
+                continue;                                                                      \
+            }                                                                                  \
+            T zr = 0, zi = 0, sr = 0, si = 0, mag = 0;                                         \
+            int next_save = 1, iter;                                                           \
+            bool periodic = false;                                                             \
+            for (iter = 0; iter < config->max_iter; ++iter) {                                  \
+                T zr2 = zr * zr, zi2 = zi * zi;                                                \
+                if (zr2 + zi2 > 4) {                                                           \
+                    mag = zr2 + zi2;                                                           \
+                    break;                                                                     \
+                }                                                                              \
+                T tmp = zr2 - zi2 + cr;                                                        \
+                zi = 2 * zr * zi + ci;                                                         \
+                zr = tmp;                                                                      \
+                if (config->period) {                                                          \
+                    T dr = zr - sr, di = zi - si;                                              \
+                    if (dr * dr + di * di < (EPS) * (EPS)) {                                   \
+                        periodic = true;                                                       \
+                        ++iter;                                                                \
+                        break;                                                                 \
+                    }                                                                          \
+                    if (iter + 1 == next_save) {                                               \
+                        sr = zr;                                                               \
+                        si = zi;                                                               \
+                        next_save *= 2;                                                        \
+                    }                                                                          \
+                }                                                                              \
+            }                                                                                  \
+            stats->periodic += periodic;                                                       \
+            stats->iterations += iter;                                                         \
+            int value = periodic ? 0                                                           \
+                        : config->smooth ? smooth_value(iter, (double)mag, config->max_iter)   \
+                        : config->max_iter - iter;                                             \
+            store_iter(out, i, value, bytes);                                                  \
+        }                                                                                      \
+    }
+
+#define VIEW_DOUBLE(config, field) ((config)->field)
+#define VIEW_LONG(config, field) ((config)->field##_long)
+
+SCALAR_ROW_KERNEL(escape_row_scalar_float, float, double, PERIOD_EPS_FLOAT, VIEW_DOUBLE)
+SCALAR_ROW_KERNEL(escape_row_scalar_long, long double, long double, PERIOD_EPS_LONG, VIEW_LONG)
+SCALAR_ROW_KERNEL(escape_row_scalar_smooth, double, double, PERIOD_EPS, VIEW_DOUBLE)
+
+ROW_KERNEL_WIDTHS(escape_row_scalar, escape_row_scalar)
+ROW_KERNEL_WIDTHS(escape_row_scalar_float, escape_row_scalar_float)
+ROW_KERNEL_WIDTHS(escape_row_scalar_long, escape_row_scalar_long)
+ROW_KERNEL_WIDTHS(escape_row_scalar_smooth, escape_row_scalar_smooth)
+
+// One instance of the lane kernel per instruction set, chosen at runtime
+#if defined(__x86_64__) || defined(__i386__)
+ROW_KERNEL_WIDTHS(escape_row_avx512, escape_row_lanes, __attribute__((target("avx512f"))))
+ROW_KERNEL_WIDTHS(escape_row_avx2, escape_row_lanes, __attribute__((target("avx2,fma"))))
+ROW_KERNEL_WIDTHS(escape_row_avx512_float, escape_row_lanes_float,
+                  __attribute__((target("avx512f"))))
+ROW_KERNEL_WIDTHS(escape_row_avx2_float, escape_row_lanes_float, __attribute__((target("avx2,fma"))))
+#endif
+
+// Baseline build target: SSE2 on x86-64, NEON on aarch64
+ROW_KERNEL_WIDTHS(escape_row_vector, escape_row_lanes)
+ROW_KERNEL_WIDTHS(escape_row_vector_float, escape_row_lanes_float)
+
+/**
+ * @brief Resolves precision=auto for the view.
+ *
+ * A type is fine while the pixel spacing spans at least PRECISION_MARGIN
+ * ulps at the view's magnitude (at least 2, the escape radius), so
+ * neighbouring pixels stay distinct and rounding stays well below a pixel
+ * for the length of a typical orbit.
+ * @param config A pointer to the configuration struct.
+ * @return PRECISION_FLOAT, PRECISION_DOUBLE or PRECISION_LONG.
+ */
+static Precision resolve_precision(const Config *config) {
+    if (config->precision != PRECISION_AUTO) {
+        return config->precision;
+    }
+    double spacing = fmin((config->ur_x - config->ll_x) / config->width,
+                          (config->ur_y - config->ll_y) / config->height);
+    double magnitude = fmax(fmax(fabs(config->ll_x), fabs(config->ur_x)),
+                            fmax(fmax(fabs(config->ll_y), fabs(config->ur_y)), 2.0));
+    if (spacing > magnitude * FLT_EPSILON * PRECISION_MARGIN) {
+        return PRECISION_FLOAT;
+    }
+    if (spacing > magnitude * DBL_EPSILON * PRECISION_MARGIN) {
+        return PRECISION_DOUBLE;
+    }
+    return PRECISION_LONG;
+}
+
+/**
+ * @brief Picks the widest row kernel the running CPU supports.
+ * @param config A pointer to the configuration struct (simd=0 forces
+ *        scalar; precision resolved).
+ * @param bytes The element width of the buffers the kernel writes.
+ * @return The row kernel to use for this render.
+ */
+static row_kernel_fn select_row_kernel(const Config *config, int bytes) {
+    bool single = config->precision == PRECISION_FLOAT;
+    if (config->precision == PRECISION_LONG) {
+        return ROW_KERNEL_FOR(escape_row_scalar_long, bytes); // no vector long double
+    }
+    if (!config->simd) {
+        return single ? ROW_KERNEL_FOR(escape_row_scalar_float, bytes)
+               : config->smooth ? ROW_KERNEL_FOR(escape_row_scalar_smooth, bytes)
+               : ROW_KERNEL_FOR(escape_row_scalar, bytes);
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return single ? ROW_KERNEL_FOR(escape_row_avx512_float, bytes)
+                      : ROW_KERNEL_FOR(escape_row_avx512, bytes);
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return single ? ROW_KERNEL_FOR(escape_row_avx2_float, bytes)
+                      : ROW_KERNEL_FOR(escape_row_avx2, bytes);
+    }
+#endif
+    return single ? ROW_KERNEL_FOR(escape_row_vector_float, bytes)
+                  : ROW_KERNEL_FOR(escape_row_vector, bytes);
+}
+
+/*
+ * Perturbation engine (engine=perturb).
+ *
+ * Past a zoom of about 1e-13, neighbouring pixels map to the same double.
+ * Instead, one reference orbit Z_n at the view centre is iterated in
+ * fixed-point arithmetic. Every pixel then iterates only its offset
+ * dz_n = z_n - Z_n in double:
+ *
+ *     dz_{n+1} = (2 Z_n + dz_n) dz_n + dc
+ *
+ * A pixel is glitched when |Z_n + dz_n| < |dz_n|: the reference no longer
+ * approximates the pixel's orbit. It is then rebased (dz = Z_n + dz_n,
+ * n = 0), which also covers a reference that escapes before the pixel does.
+ */
+
+/**
+ * A signed fixed-point number: limb[0] is the integer part and limb[i]
+ * carries weight 2^(-32 i). Arithmetic uses the first n limbs.
+ */
+typedef struct {
+    bool neg;
+    uint32_t limb[FIXED_LIMBS_MAX];
+} Fixed;
+
+// Compares magnitudes: <0, 0, >0
+static int fixed_cmp_mag(const Fixed *a, const Fixed *b, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (a->limb[i] != b->limb[i]) {
+            return a->limb[i] < b->limb[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r = |a| + |b| (magnitudes only)
+static void fixed_add_mag(const Fixed *a, const Fixed *b, Fixed *r, int n) {
+    uint64_t carry = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        uint64_t t = (uint64_t)a->limb[i] + b->limb[i] + carry;
+        r->limb[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+}
+
+// r = |a| - |b|, requires |a| >= |b|
+static void fixed_sub_mag(const Fixed *a, const Fixed *b, Fixed *r, int n) {
+    int64_t borrow = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        int64_t t = (int64_t)a->limb[i] - b->limb[i] - borrow;
+        borrow = t < 0;
+        r->limb[i] = (uint32_t)(t + (borrow << 32));
+    }
+}
+
+// r = a + b (r may alias a or b)
+static void fixed_add(const Fixed *a, const Fixed *b, Fixed *r, int n) {
+    if (a->neg == b->neg) {
+        r->neg = a->neg;
+        fixed_add_mag(a, b, r, n);
+    } else if (fixed_cmp_mag(a, b, n) >= 0) {
+        r->neg = a->neg;
+        fixed_sub_mag(a, b, r, n);
+    } else {
+        r->neg = b->neg;
+        fixed_sub_mag(b, a, r, n);
+    }
+}
+
+// r = a - b (r may alias a or b)
+static void fixed_sub(const Fixed *a, const Fixed *b, Fixed *r, int n) {
+    Fixed nb = *b;
+    nb.neg = !b->neg;
+    fixed_add(a, &nb, r, n);
+}
+
+// r = a * b, truncated to n limbs (r may alias a or b)
+static void fixed_mul(const Fixed *a, const Fixed *b, Fixed *r, int n) {
+    uint32_t w[FIXED_LIMBS_MAX + 1] = {0}; // one guard limb
+
+    // Least significant first so carries move towards limb 0
+    for (int i = n - 1; i >= 0; --i) {
+        uint64_t carry = 0;
+        int j_max = n - i < n - 1 ? n - i : n - 1;
+        for (int j = j_max; j >= 0; --j) {
+            uint64_t t = (uint64_t)a->limb[i] * b->limb[j] + w[i + j] + carry;
+            w[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (i > 0) {
+            w[i - 1] += (uint32_t)carry;
+        }
+    }
+    r->neg = a->neg != b->neg;
+    memcpy(r->limb, w, sizeof(uint32_t) * n);
+}
+
+// x = x / d for a small divisor
+static void fixed_div_small(Fixed *x, uint32_t d, int n) {
+    uint64_t rem = 0;
+    for (int i = 0; i < n; ++i) {
+        uint64_t cur = rem << 32 | x->limb[i];
+        x->limb[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+}
+
+// x = x * m for a small multiplier
+static void fixed_mul_small(Fixed *x, uint32_t m, int n) {
+    uint64_t carry = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        uint64_t t = (uint64_t)x->limb[i] * m + carry;
+        x->limb[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+}
+
+static double fixed_to_double(const Fixed *x, int n) {
+    double v = 0.0;
+    for (int i = n - 1; i >= 0; --i) {
+        v += ldexp((double)x->limb[i], -32 * i);
+    }
+    return x->neg ? -v : v;
+}
+
+/**
+ * @brief Parses a decimal string such as "-0.7436438870371587047521915" or "1.5e-20".
+ * @param text The number as given on the command line.
+ * @param x Receives the value, exact to the last limb.
+ * @return false if the string is not a number.
+ */
+static bool fixed_from_string(const char *text, Fixed *x) {
+    const int n = FIXED_LIMBS_MAX;
+    *x = (Fixed){0};
+
+    const char *p = text;
+    if (*p == '-' || *p == '+') {
+        x->neg = *p++ == '-';
+    }
+
+    const char *int_start = p;
+    while (*p >= '0' && *p <= '9') ++p;
+    const char *int_end = p;
+    const char *frac_start = p, *frac_end = p;
+    if (*p == '.') {
+        frac_start = ++p;
+        while (*p >= '0' && *p <= '9') ++p;
+        frac_end = p;
+    }
+    if (int_start == int_end && frac_start == frac_end) {
+        return false;
+    }
+
+    int exponent = 0;
+    if (*p == 'e' || *p == 'E') {
+        char *end;
+        exponent = (int)strtol(p + 1, &end, 10);
+        p = end;
+    }
+    if (*p != '\0') {
+        return false;
+    }
+
+    // Fraction digits from the last one back: f = (digit + f) / 10
+    for (const char *d = frac_end; d > frac_start; --d) {
+        x->limb[0] = (uint32_t)(d[-1] - '0');
+        fixed_div_small(x, 10, n);
+    }
+    uint64_t int_part = 0;
+    for (const char *d = int_start; d < int_end; ++d) {
+        int_part = int_part * 10 + (uint64_t)(*d - '0');
+    }
+    x->limb[0] = (uint32_t)int_part;
+
+    for (; exponent > 0; --exponent) fixed_mul_small(x, 10, n);
+    for (; exponent < 0; ++exponent) fixed_div_small(x, 10, n);
+    return true;
+}
+
+/**
+ * @brief Computes the reference orbit at the centre of the view.
+ *
+ * Precision follows the pixel spacing: enough limbs to resolve it with
+ * 64 bits to spare, up to FIXED_LIMBS_MAX.
+ * @param config A pointer to the configuration struct. Coordinate strings
+ *        that are NULL are taken from the doubles.
+ * @return The orbit; exits on malformed coordinates.
+ */
+static PerturbOrbit *perturb_orbit_build(const Config *config) {
+    const char *text[4] = {config->ll_x_str, config->ll_y_str, config->ur_x_str, config->ur_y_str};
+    const double value[4] = {config->ll_x, config->ll_y, config->ur_x, config->ur_y};
+    char digits[4][32];
+    Fixed v[4];
+    for (int i = 0; i < 4; ++i) {
+        if (!text[i]) {
+            snprintf(digits[i], sizeof(digits[i]), "%.17g", value[i]);
+            text[i] = digits[i];
+        }
+        if (!fixed_from_string(text[i], &v[i])) {
+            fprintf(stderr, "Error: Cannot parse coordinate '%s'\n", text[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    Fixed fw, fh, cr, ci;
+    fixed_sub(&v[2], &v[0], &fw, FIXED_LIMBS_MAX);
+    fixed_sub(&v[3], &v[1], &fh, FIXED_LIMBS_MAX);
+    fixed_add(&v[0], &v[2], &cr, FIXED_LIMBS_MAX);
+    fixed_add(&v[1], &v[3], &ci, FIXED_LIMBS_MAX);
+    fixed_div_small(&cr, 2, FIXED_LIMBS_MAX);
+    fixed_div_small(&ci, 2, FIXED_LIMBS_MAX);
+
+    PerturbOrbit *orbit = malloc(sizeof(PerturbOrbit));
+    if (!orbit) {
+        perror("Failed to allocate reference orbit");
+        exit(EXIT_FAILURE);
+    }
+    orbit->fwidth = fixed_to_double(&fw, FIXED_LIMBS_MAX);
+    orbit->fheight = fixed_to_double(&fh, FIXED_LIMBS_MAX);
+
+    double spacing = fmin(fabs(orbit->fwidth) / config->width, fabs(orbit->fheight) / config->height);
+    int bits = (spacing > 0 ? (int)ceil(-log2(spacing)) : 32 * FIXED_LIMBS_MAX) + 64;
+    int n = bits / 32 + 2;
+    if (n > FIXED_LIMBS_MAX) {
+        fprintf(stderr, "Warning: Zoom needs %d bits, reference orbit limited to %d\n",
+                bits, 32 * (FIXED_LIMBS_MAX - 1));
+        n = FIXED_LIMBS_MAX;
+    }
+    if (spacing < 1e-290) {
+        fprintf(stderr, "Warning: Pixel spacing %g is beyond the range of double deltas\n", spacing);
+    }
+
+    orbit->zr = malloc(sizeof(double) * (config->max_iter + 1));
+    orbit->zi = malloc(sizeof(double) * (config->max_iter + 1));
+    if (!orbit->zr || !orbit->zi) {
+        perror("Failed to allocate reference orbit");
+        exit(EXIT_FAILURE);
+    }
+
+    Fixed zr = {0}, zi = {0}, zr2, zi2, zri;
+    orbit->len = 0;
+    for (int iter = 0; iter <= config->max_iter; ++iter) {
+        double dr = fixed_to_double(&zr, n), di = fixed_to_double(&zi, n);
+        orbit->zr[orbit->len] = dr;
+        orbit->zi[orbit->len] = di;
+        orbit->len++;
+        if (dr * dr + di * di > 4.0) {
+            break;
+        }
+        fixed_mul(&zr, &zr, &zr2, n);
+        fixed_mul(&zi, &zi, &zi2, n);
+        fixed_mul(&zr, &zi, &zri, n);
+        fixed_sub(&zr2, &zi2, &zr, n);
+        fixed_add(&zr, &cr, &zr, n);
+        fixed_add(&zri, &zri, &zi, n);
+        fixed_add(&zi, &ci, &zi, n);
+    }
+    return orbit;
+}
+
+static void perturb_orbit_free(PerturbOrbit *orbit) {
+    if (orbit) {
+        free(orbit->zr);
+        free(orbit->zi);
+        free(orbit);
+    }
+}
+
+/**
+ * @brief escape_time() for the pixel at offset dc from the reference point.
+ * @param orbit The reference orbit.
+ * @param dcr The real offset of c from the reference point.
+ * @param dci The imaginary offset of c from the reference point.
+ * @param max_iter The maximum number of iterations.
+ * @param rebases Incremented for every glitch rebase.
+ * @param escape_mag Receives |z|^2 at escape (left unchanged inside the set).
+ * @return An integer representing how close the point is to the set.
+ */
+static inline int perturb_escape_time(const PerturbOrbit *orbit, double dcr, double dci,
+                                      int max_iter, long long *rebases, double *escape_mag) {
+    double dzr = 0.0, dzi = 0.0;
+    int m = 0; // index into the reference orbit
+    int iter;
+
+    for (iter = 0; iter < max_iter; ++iter) {
+        double zr = orbit->zr[m] + dzr;
+        double zi = orbit->zi[m] + dzi;
+        double mag = zr * zr + zi * zi;
+        if (mag > 4.0) {
+            *escape_mag = mag;
+            break;
+        }
+        if (mag < dzr * dzr + dzi * dzi || m == orbit->len - 1) {
+            dzr = zr; // glitch or end of reference: rebase onto Z_0 = 0
+            dzi = zi;
+            m = 0;
+            ++*rebases;
+        }
+        double tr = 2.0 * orbit->zr[m] + dzr;
+        double ti = 2.0 * orbit->zi[m] + dzi;
+        double ndzr = tr * dzr - ti * dzi + dcr;
+        dzi = tr * dzi + ti * dzr + dci;
+        dzr = ndzr;
+        ++m;
+    }
+    return max_iter - iter;
+}
+
+// Row kernel for engine=perturb - pixel offsets are exact in double at any zoom
+static inline __attribute__((always_inline))
+void perturb_row(const Config *config, int y, int x_start, int x_end, void *out,
+                 KernelStats *stats, int bytes) {
+    const PerturbOrbit *orbit = config->orbit;
+    double dci = 0.5 * orbit->fheight - y * orbit->fheight / config->height;
+
+    for (int x = x_start, i = 0; x < x_end; x += config->x_step, ++i) {
+        double dcr = x * orbit->fwidth / config->width - 0.5 * orbit->fwidth;
+        double mag = 0.0;
+        int iter = perturb_escape_time(orbit, dcr, dci, config->max_iter, &stats->rebases, &mag);
+        stats->iterations += config->max_iter - iter;
+        int value = config->smooth ? smooth_value(config->max_iter - iter, mag, config->max_iter)
+                                   : iter;
+        store_iter(out, i, value, bytes);
+    }
+}
+
+ROW_KERNEL_WIDTHS(perturb_row, perturb_row)
+
+/**
+ * @brief Picks the number of rows handed out per atomic fetch.
+ *
+ * Aims for roughly CHUNK_TARGET_WORK pixel-iterations per task (assuming
+ * the worst case of max_iter per pixel), so wide, cheap rows are batched and
+ * the shared row counter is not hammered, while still leaving TASKS_PER_THREAD tasks
+ * per thread so the tail of the frame balances out.
+ * @param config A pointer to the configuration struct (threads resolved).
+ * @return The chunk size in rows, at least 1.
+ */
+static int auto_chunk_size(const Config *config) {
+    double row_work = (double)config->width * config->max_iter;
+    int chunk = row_work > 0 ? (int)fmin(CHUNK_TARGET_WORK / row_work, config->height) : 1;
+    int max_chunk = config->height / (config->threads * TASKS_PER_THREAD);
+
+    if (chunk > max_chunk) {
+        chunk = max_chunk;
+    }
+    return chunk < 1 ? 1 : chunk;
+}
+
+/**
+ * A worker's share of the tile index space, [top, bottom), packed into one
+ * 64-bit word so the owner and thieves can both update it with a single CAS.
+ * The owner takes tiles from the top (in order, for locality); thieves take
+ * the bottom half. Only the owner refills its own deque, and only when empty.
+ * Padded to a cache line so neighbouring deques do not false-share.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic uint64_t range;
+} TileDeque;
+
+typedef struct {
+    int tile;     // Tile edge in pixels
+    int tiles_x;  // Tiles per tile row
+    int ntiles;
+    int nworkers;
+    TileDeque *deques; // One per worker
+} TileScheduler;
+
+static inline uint64_t pack_range(uint32_t top, uint32_t bottom) {
+    return (uint64_t)bottom << 32 | top;
+}
+
+static inline uint32_t range_top(uint64_t range) {
+    return (uint32_t)range;
+}
+
+static inline uint32_t range_bottom(uint64_t range) {
+    return (uint32_t)(range >> 32);
+}
+
+/**
+ * @brief Splits the frame into tiles and deals each worker a contiguous run.
+ * @param sched The scheduler to initialise.
+ * @param config A pointer to the configuration struct (threads resolved).
+ * @param deques config->threads deques, owned by the pool.
+ */
+static void tile_scheduler_init(TileScheduler *sched, const Config *config, TileDeque *deques) {
+    sched->tile = config->tile > 0 ? config->tile : 64;
+    sched->tiles_x = (config->width + sched->tile - 1) / sched->tile;
+    int tiles_y = (config->height + sched->tile - 1) / sched->tile;
+    sched->ntiles = sched->tiles_x * tiles_y;
+    sched->nworkers = config->threads;
+    sched->deques = deques;
+
+    for (int i = 0; i < sched->nworkers; ++i) {
+        uint32_t top = (uint32_t)((int64_t)sched->ntiles * i / sched->nworkers);
+        uint32_t bottom = (uint32_t)((int64_t)sched->ntiles * (i + 1) / sched->nworkers);
+        atomic_init(&sched->deques[i].range, pack_range(top, bottom));
+    }
+}
+
+/**
+ * @brief Takes the next tile from the worker's own deque.
+ * @return The tile index, or -1 if the deque is empty.
+ */
+static int tile_pop(TileDeque *deque) {
+    uint64_t range = atomic_load(&deque->range);
+    while (range_top(range) < range_bottom(range)) {
+        uint64_t next = pack_range(range_top(range) + 1, range_bottom(range));
+        if (atomic_compare_exchange_weak(&deque->range, &range, next)) {
+            return (int)range_top(range);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Steals the bottom half of some other worker's deque.
+ *
+ * The first stolen tile is returned; the rest are installed in the thief's
+ * own (empty) deque.
+ * @return A tile index, or -1 if every deque is empty.
+ */
+static int tile_steal(TileScheduler *sched, int self) {
+    for (int i = 1; i < sched->nworkers; ++i) {
+        TileDeque *victim = &sched->deques[(self + i) % sched->nworkers];
+        uint64_t range = atomic_load(&victim->range);
+
+        while (range_top(range) < range_bottom(range)) {
+            uint32_t top = range_top(range), bottom = range_bottom(range);
+            uint32_t split = bottom - (bottom - top + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, pack_range(top, split))) {
+                atomic_store(&sched->deques[self].range, pack_range(split + 1, bottom));
+                return (int)split;
+            }
+        }
+    }
+    return -1;
+}
+
+typedef struct {
+    int band;  // Band this slot holds, or may hold next
+    bool done; // All rows of @band are computed
+    void *rows; // band_rows * width values, output_bytes each
+} StreamSlot;
+
+/**
+ * Ring buffer of row bands for stream=1. Bands are numbered in output order
+ * and band b lives in slot b % nslots. A worker computing band b waits until
+ * the writer has released band b - nslots; the writer waits for band b to be
+ * done, writes it, and hands the slot on to band b + nslots. Peak memory is
+ * nslots * band_rows rows whatever the frame size.
+ */
+typedef struct StreamRing {
+    bool bottom_up; // Bands are numbered from the bottom of the image
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free; // the writer released a slot
+    pthread_cond_t band_done; // a worker completed a band
+    atomic_int next_band;
+    int nbands;
+    int band_rows;
+    int nslots;
+    StreamSlot *slots;
+} StreamRing;
+
+static void stream_ring_init(StreamRing *ring, const Config *config, bool bottom_up) {
+    ring->bottom_up = bottom_up;
+    ring->band_rows = config->band > 0 ? config->band : config->chunk;
+    ring->nbands = (config->height + ring->band_rows - 1) / ring->band_rows;
+    ring->nslots = config->bands > 0 ? config->bands : 2 * config->threads;
+    atomic_init(&ring->next_band, 0);
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->slot_free, NULL);
+    pthread_cond_init(&ring->band_done, NULL);
+
+    ring->slots = malloc(sizeof(StreamSlot) * ring->nslots);
+    if (!ring->slots) {
+        perror("Failed to allocate band ring");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ring->nslots; ++i) {
+        ring->slots[i].band = i;
+        ring->slots[i].done = false;
+        ring->slots[i].rows = malloc((size_t)config->output_bytes * ring->band_rows * config->width);
+        if (!ring->slots[i].rows) {
+            perror("Failed to allocate band ring");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void stream_ring_free(StreamRing *ring) {
+    for (int i = 0; i < ring->nslots; ++i) {
+        free(ring->slots[i].rows);
+    }
+    free(ring->slots);
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->slot_free);
+    pthread_cond_destroy(&ring->band_done);
+}
+
+// First image row and row count of band b
+static void stream_band_rows(const Config *config, const StreamRing *ring, int b,
+                             int *y_lo, int *rows) {
+    int r0 = b * ring->band_rows;
+    int r1 = r0 + ring->band_rows < config->height ? r0 + ring->band_rows : config->height;
+    *y_lo = ring->bottom_up ? config->height - r1 : r0;
+    *rows = r1 - r0;
+}
+
+/**
+ * One pass of render_pool_progressive(). Block row j covers the image rows
+ * [j * step, (j + 1) * step). Its top row is computed at every step-th
+ * column in the first pass and in odd block rows; even block rows only
+ * need the odd multiples of step, since the previous pass computed the
+ * even ones. The top row is then copied over the rest of the block.
+ */
+typedef struct {
+    int step;
+    bool first;      // The coarsest pass: every block row is computed in full
+    Config dense;    // x_step = step
+    Config sparse;   // x_step = 2 * step, from column step
+    int nblocks;     // Block rows in the frame
+    int per_task;    // Block rows handed out per fetch
+    atomic_int next_block;
+    atomic_bool *cancel; // The pool's render_pool_cancel() flag
+} ProgressivePass;
+
+/**
+ * The edge pass of aa=N after a frame is rendered: first every pixel whose
+ * value differs from one of its four neighbours is marked, then the marked
+ * pixels are recomputed as the mean of N x N samples. fine is the frame at
+ * N times the resolution, moved by half a sample so that the samples of
+ * pixel (x, y), rows y * N + j and columns x * N + i, sit at the centres of
+ * an even grid on [x, x + 1) x [y, y + 1); only those samples are computed.
+ */
+typedef struct {
+    int n;
+    bool marking;   // Mark the edges; otherwise supersample them
+    Config fine;
+    uint8_t *edges; // One flag per pixel
+    int chunk;      // Rows per task
+    atomic_int next_row;
+} AaPass;
+
+typedef struct {
+    int x0, y0, x1, y1;
+} PanRect;
+
+/**
+ * The strips render_pool_pan() computes: the rows and the columns that
+ * came into view (render_pool_region(): its one band). Their rows are
+ * numbered one after the other and handed out chunk at a time.
+ */
+typedef struct {
+    PanRect rects[2];
+    int nrects;
+    int rows;    // Rows of all rects
+    int chunk;   // Rows per task
+    atomic_int next_row;
+} PanStrips;
+
+/**
+ * A render_pool_pin() or render_pool_alloc() run: instead of rendering,
+ * each worker pins itself to its CPU or first-touches its band of a buffer.
+ */
+typedef struct {
+    const int *cpus;    // pin: the CPUs of the process's affinity mask, in order
+    int ncpus;          // 0 = no pinning
+    atomic_bool failed; // A worker's pthread_setaffinity_np() was refused
+    char *base;         // alloc: the buffer to touch; NULL = none
+    size_t size;
+    size_t page;        // Bytes per page of the buffer
+} PoolPlacement;
+
+typedef struct {
+    int id;
+    const Config *config;
+    row_kernel_fn kernel;       // Writes pixel_bytes-wide values into output_buffer
+    row_kernel_fn kernel32;     // Writes int values into the Mariani-Silver scratch block
+    row_kernel_fn pixel_kernel; // kernel32 for single pixels, where vector lanes would be wasted
+    TileScheduler *sched;
+    atomic_int *next_y;  // Next row to hand out (sched=rows), shared by the frame's workers
+    struct StreamRing *ring; // Band ring buffer (stream=1)
+    void *output_buffer; // Pointer to the result array (output_bytes per element)
+    size_t stride;       // Bytes between rows of output_buffer
+    int buffer_y0;       // Image row held by the first row of output_buffer
+    int *scratch;        // Mariani-Silver block, int so it can hold UNKNOWN
+    size_t scratch_len;
+    void *values;        // palette=: one row of values, coloured into output_buffer
+    size_t values_len;
+    Histogram *counts;   // hist=: histogram, or NULL when the frame is not counted
+    Histogram *histogram; // This worker's histogram, kept across frames
+    ProgressivePass *pass; // render_pool_progressive(): the pass being computed
+    PanStrips *strips;   // render_pool_pan(), render_pool_region(): the strips to compute
+    AaPass *aa;          // aa=: the edge pass
+    PoolPlacement *place; // render_pool_pin(), render_pool_alloc(): the placement run
+    band_fn sink;        // render_pool_rows(): receives each chunk, on this thread
+    void *sink_ctx;
+    void *band;          // render_pool_rows(): the chunk being computed
+    size_t band_len;
+    int block_x0;        // Image position and width of the scratch block
+    int block_y0;
+    int block_width;
+    KernelStats stats;   // Per-thread counters, summed after the join
+    WorkerStats work;    // stats=1 instrumentation
+    double frame_start;  // bench_now() when run_frame() released the workers
+} ThreadArgs;
+
+/**
+ * Worker threads kept alive across frames. run_frame() fills in the
+ * workers' ThreadArgs, bumps generation and waits until running drops back
+ * to zero; each worker sleeps on start between frames. The ThreadArgs
+ * (with their Mariani-Silver scratch) and the tile deques are allocated
+ * once per pool, not per frame.
+ */
+struct RenderPool {
+    int nthreads;
+    pthread_t *threads;
+    ThreadArgs *args;   // One per worker
+    TileDeque *deques;  // One per worker
+    pthread_mutex_t lock;
+    pthread_cond_t start; // a frame was posted, or the pool is shutting down
+    pthread_cond_t done;  // the last worker finished the frame
+    long generation;      // Frames posted so far
+    int running;          // Workers still on the current frame
+    int started;          // Workers that have claimed their ThreadArgs
+    bool shutdown;
+    GpuContext *gpu;      // engine=gpu device, opened by the first GPU frame
+    bool gpu_tried;       // gpu_open() has run (gpu stays NULL if it failed)
+    ColourMap *colours;   // palette=: the last frame's table, rebuilt when it changes
+    atomic_bool cancel;   // render_pool_cancel() was called during this render
+};
+
+static inline void *pixel_ptr(const ThreadArgs *args, int x, int y) {
+    return (char *)args->output_buffer + (size_t)(y - args->buffer_y0) * args->stride +
+           (size_t)x * args->config->output_bytes;
+}
+
+#define UNKNOWN (-1) // Marks pixels not yet computed during Mariani-Silver subdivision
+
+static inline int *mariani_at(const ThreadArgs *args, int x, int y) {
+    return &args->scratch[(size_t)(y - args->block_y0) * args->block_width + (x - args->block_x0)];
+}
+
+// Computes the still-unknown pixels of row y in [x_start, x_end), in runs
+static void mariani_span(ThreadArgs *args, int y, int x_start, int x_end) {
+    int *row = mariani_at(args, x_start, y);
+
+    for (int x = x_start; x < x_end; ) {
+        if (row[x - x_start] != UNKNOWN) {
+            ++x;
+            continue;
+        }
+        int run = x;
+        while (run < x_end && row[run - x_start] == UNKNOWN) ++run;
+        args->kernel32(args->config, y, x, run, &row[x - x_start], &args->stats);
+        x = run;
+    }
+}
+
+// Computes one still-unknown pixel with the pixel kernel (no wasted lanes)
+static void mariani_pixel(ThreadArgs *args, int x, int y) {
+    int *p = mariani_at(args, x, y);
+    if (*p == UNKNOWN) {
+        args->pixel_kernel(args->config, y, x, x + 1, p, &args->stats);
+    }
+}
+
+/**
+ * @brief Mariani-Silver subdivision of the rectangle [x0, x1) x [y0, y1).
+ *
+ * Computes the border. If every border pixel has the same value, the
+ * interior is filled with it (the set and its level sets are connected, so
+ * nothing different can hide inside). Otherwise the rectangle is split along
+ * its longer side, with the halves sharing the dividing line, and each half
+ * recurses. Pixels already computed by a neighbour are not recomputed.
+ */
+static void mariani_rect(ThreadArgs *args, int x0, int y0, int x1, int y1) {
+    mariani_span(args, y0, x0, x1);
+    mariani_span(args, y1 - 1, x0, x1);
+    for (int y = y0 + 1; y < y1 - 1; ++y) {
+        mariani_pixel(args, x0, y);
+        mariani_pixel(args, x1 - 1, y);
+    }
+    if (x1 - x0 <= 2 || y1 - y0 <= 2) {
+        return; // all border, no interior
+    }
+
+    const int *top = mariani_at(args, x0, y0);
+    const int *bottom = mariani_at(args, x0, y1 - 1);
+    int value = top[0];
+    bool uniform = true;
+    for (int i = 0; i < x1 - x0 && uniform; ++i) {
+        uniform = top[i] == value && bottom[i] == value;
+    }
+    for (int y = y0 + 1; y < y1 - 1 && uniform; ++y) {
+        const int *row = mariani_at(args, x0, y);
+        uniform = row[0] == value && row[x1 - x0 - 1] == value;
+    }
+
+    if (uniform) {
+        for (int y = y0 + 1; y < y1 - 1; ++y) {
+            int *row = mariani_at(args, x0, y);
+            for (int i = 1; i < x1 - x0 - 1; ++i) {
+                row[i] = value;
+            }
+        }
+        args->stats.filled += (long long)(x1 - x0 - 2) * (y1 - y0 - 2);
+    } else if (x1 - x0 <= MARIANI_MIN || y1 - y0 <= MARIANI_MIN) {
+        for (int y = y0 + 1; y < y1 - 1; ++y) {
+            mariani_span(args, y, x0 + 1, x1 - 1);
+        }
+    } else if (x1 - x0 >= y1 - y0) {
+        int xm = (x0 + x1) / 2;
+        mariani_rect(args, x0, y0, xm + 1, y1);
+        mariani_rect(args, xm, y0, x1, y1);
+    } else {
+        int ym = (y0 + y1) / 2;
+        mariani_rect(args, x0, y0, x1, ym + 1);
+        mariani_rect(args, x0, ym, x1, y1);
+    }
+}
+
+// Narrows n int values into a buffer of bytes-wide elements
+static inline __attribute__((always_inline))
+void store_iters(void *out, const int *in, int n, int bytes) {
+    for (int i = 0; i < n; ++i) {
+        store_iter(out, i, in[i], bytes);
+    }
+}
+
+static void store_row(void *out, const int *in, int n, int bytes) {
+    switch (bytes) {
+    case 1: store_iters(out, in, n, 1); break;
+    case 2: store_iters(out, in, n, 2); break;
+    default: store_iters(out, in, n, 4); break;
+    }
+}
+
+// stats=1: counts the block just rendered into args->work
+static void record_block(ThreadArgs *args, int x_start, int y_start, int x_end, int y_end,
+                         double t0) {
+    WorkerStats *work = &args->work;
+    double t1 = bench_now();
+    work->tasks++;
+    work->rows += y_end - y_start;
+    work->pixels += (long long)(x_end - x_start) * (y_end - y_start);
+    work->busy += t1 - t0;
+    work->last = t1 - args->frame_start;
+}
+
+// Computes the block [x_start, x_end) x [y_start, y_end) with the selected algorithm
+static void render_block(ThreadArgs *args, int x_start, int y_start, int x_end, int y_end) {
+    const Config *config = args->config;
+    double t0 = config->stats ? bench_now() : 0.0;
+
+    if (config->algo == ALGO_MARIANI) {
+        size_t len = (size_t)(x_end - x_start) * (y_end - y_start);
+        if (len > args->scratch_len) {
+            free(args->scratch);
+            args->scratch = malloc(sizeof(int) * len);
+            args->scratch_len = len;
+            if (!args->scratch) {
+                perror("Failed to allocate Mariani-Silver block");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (size_t i = 0; i < len; ++i) {
+            args->scratch[i] = UNKNOWN;
+        }
+        args->block_x0 = x_start;
+        args->block_y0 = y_start;
+        args->block_width = x_end - x_start;
+
+        mariani_rect(args, x_start, y_start, x_end, y_end);
+        for (int y = y_start; y < y_end; ++y) {
+            if (args->counts) {
+                histogram_add(args->counts, mariani_at(args, x_start, y), x_end - x_start,
+                              sizeof(int));
+            }
+            if (config->colours) {
+                colour_row(config->colours, mariani_at(args, x_start, y), x_end - x_start,
+                           sizeof(int), pixel_ptr(args, x_start, y));
+            } else {
+                store_row(pixel_ptr(args, x_start, y), mariani_at(args, x_start, y),
+                          x_end - x_start, config->pixel_bytes);
+            }
+        }
+    } else if (config->colours) {
+        // Each row is coloured straight after its kernel, while it is still in L1
+        size_t len = (size_t)(x_end - x_start) * config->pixel_bytes;
+        if (len > args->values_len) {
+            free(args->values);
+            args->values = malloc(len);
+            args->values_len = len;
+            if (!args->values) {
+                perror("Failed to allocate colour row");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int y = y_start; y < y_end; ++y) {
+            args->kernel(config, y, x_start, x_end, args->values, &args->stats);
+            if (args->counts) {
+                histogram_add(args->counts, args->values, x_end - x_start, config->pixel_bytes);
+            }
+            colour_row(config->colours, args->values, x_end - x_start, config->pixel_bytes,
+                       pixel_ptr(args, x_start, y));
+        }
+    } else {
+        for (int y = y_start; y < y_end; ++y) {
+            void *row = pixel_ptr(args, x_start, y);
+            args->kernel(config, y, x_start, x_end, row, &args->stats);
+            if (args->counts) {
+                histogram_add(args->counts, row, x_end - x_start, config->pixel_bytes);
+            }
+        }
+    }
+
+    if (config->stats) {
+        record_block(args, x_start, y_start, x_end, y_end, t0);
+    }
+}
+
+// Process image tile by tile - own deque first, then steal from the others
+static void run_tiles(ThreadArgs *args) {
+    const Config *config = args->config;
+    TileScheduler *sched = args->sched;
+
+    while (true) {
+        int t = tile_pop(&sched->deques[args->id]);
+        if (t < 0) {
+            t = tile_steal(sched, args->id);
+            args->work.steals += t >= 0;
+        }
+        if (t < 0) {
+            break;
+        }
+
+        int x_start = (t % sched->tiles_x) * sched->tile;
+        int y_start = (t / sched->tiles_x) * sched->tile;
+        int x_end = x_start + sched->tile < config->width ? x_start + sched->tile : config->width;
+        int y_end = y_start + sched->tile < config->height ? y_start + sched->tile : config->height;
+
+        render_block(args, x_start, y_start, x_end, y_end);
+    }
+}
+
+// Process image row by row - threads get their next job from @next_y
+static void run_rows(ThreadArgs *args) {
+    const Config *config = args->config;
+
+    // Loop to get task chunks until the work is done
+    while (true) {
+        int y_start = atomic_fetch_add(args->next_y, config->chunk);
+        int y_end = y_start + config->chunk;
+
+        if (y_start >= config->height) {
+            break;
+        }
+
+        if (y_end > config->height) {
+            y_end = config->height;
+        }
+
+        render_block(args, 0, y_start, config->width, y_end);
+    }
+}
+
+// Process bands in output order into the ring - @next_band hands them out
+static void run_stream(ThreadArgs *args) {
+    const Config *config = args->config;
+    StreamRing *ring = args->ring;
+
+    while (true) {
+        int b = atomic_fetch_add(&ring->next_band, 1);
+        if (b >= ring->nbands) {
+            break;
+        }
+
+        StreamSlot *slot = &ring->slots[b % ring->nslots];
+        pthread_mutex_lock(&ring->lock);
+        while (slot->band != b) {
+            pthread_cond_wait(&ring->slot_free, &ring->lock);
+        }
+        pthread_mutex_unlock(&ring->lock);
+
+        int y_lo, rows;
+        stream_band_rows(config, ring, b, &y_lo, &rows);
+        args->output_buffer = slot->rows;
+        args->stride = (size_t)config->width * config->output_bytes;
+        args->buffer_y0 = y_lo;
+        render_block(args, 0, y_lo, config->width, y_lo + rows);
+
+        pthread_mutex_lock(&ring->lock);
+        slot->done = true;
+        pthread_cond_broadcast(&ring->band_done);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+// Process row chunks into a private band and hand each to @sink - render_pool_rows()
+static void run_sink(ThreadArgs *args) {
+    const Config *config = args->config;
+    size_t stride = (size_t)config->width * config->output_bytes;
+    size_t len = stride * config->chunk;
+    if (len > args->band_len) {
+        free(args->band);
+        args->band = malloc(len);
+        args->band_len = len;
+        if (!args->band) {
+            perror("Failed to allocate row band");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (true) {
+        int y_start = atomic_fetch_add(args->next_y, config->chunk);
+        if (y_start >= config->height) {
+            break;
+        }
+        int y_end = y_start + config->chunk < config->height ? y_start + config->chunk
+                                                             : config->height;
+
+        args->output_buffer = args->band;
+        args->stride = stride;
+        args->buffer_y0 = y_start;
+        render_block(args, 0, y_start, config->width, y_end);
+        args->sink(args->sink_ctx, y_start, y_end - y_start, args->band, stride);
+    }
+}
+
+// Copies n bytes-wide elements of src to every step-th element of row, from x0
+static inline __attribute__((always_inline))
+void scatter_elements(void *row, const void *src, int x0, int step, int n, int bytes) {
+    for (int i = 0; i < n; ++i) {
+        memcpy((char *)row + (size_t)(x0 + i * step) * bytes, (const char *)src + i * bytes, bytes);
+    }
+}
+
+// Copies every step-th element of row over the step - 1 elements after it
+static inline __attribute__((always_inline))
+void spread_elements(void *row, int width, int step, int bytes) {
+    for (int x = 0; x < width; x += step) {
+        const char *from = (const char *)row + (size_t)x * bytes;
+        for (int k = 1; k < step && x + k < width; ++k) {
+            memcpy((char *)row + (size_t)(x + k) * bytes, from, bytes);
+        }
+    }
+}
+
+static void scatter_row(void *row, const void *src, int x0, int step, int n, int bytes) {
+    switch (bytes) {
+    case 1: scatter_elements(row, src, x0, step, n, 1); break;
+    case 2: scatter_elements(row, src, x0, step, n, 2); break;
+    case 3: scatter_elements(row, src, x0, step, n, 3); break;
+    default: scatter_elements(row, src, x0, step, n, 4); break;
+    }
+}
+
+static void spread_row(void *row, int width, int step, int bytes) {
+    switch (bytes) {
+    case 1: spread_elements(row, width, step, 1); break;
+    case 2: spread_elements(row, width, step, 2); break;
+    case 3: spread_elements(row, width, step, 3); break;
+    default: spread_elements(row, width, step, 4); break;
+    }
+}
+
+// Computes the new pixels of block row j of the pass and fills the block from them
+static void progressive_block(ThreadArgs *args, int j) {
+    const Config *config = args->config;
+    const ProgressivePass *pass = args->pass;
+    int y = j * pass->step;
+    bool dense = pass->first || j % 2 == 1;
+    const Config *row_config = dense ? &pass->dense : &pass->sparse;
+    int x0 = dense ? 0 : pass->step;
+    int n = x0 < config->width ? (config->width - x0 + row_config->x_step - 1) / row_config->x_step
+                               : 0;
+
+    size_t len = (size_t)n * (config->pixel_bytes + (config->colours ? 3 : 0));
+    if (len > args->values_len) {
+        free(args->values);
+        args->values = malloc(len);
+        args->values_len = len;
+        if (!args->values) {
+            perror("Failed to allocate pass row");
+            exit(EXIT_FAILURE);
+        }
+    }
+    void *row = pixel_ptr(args, 0, y);
+    if (n > 0) {
+        args->kernel(row_config, y, x0, config->width, args->values, &args->stats);
+        if (args->counts) {
+            histogram_add(args->counts, args->values, n, config->pixel_bytes); // once per pixel
+        }
+        const void *samples = args->values;
+        if (config->colours) {
+            uint8_t *rgb = (uint8_t *)args->values + (size_t)n * config->pixel_bytes;
+            colour_row(config->colours, args->values, n, config->pixel_bytes, rgb);
+            samples = rgb;
+        }
+        scatter_row(row, samples, x0, row_config->x_step, n, config->output_bytes);
+    }
+    if (pass->step > 1) {
+        spread_row(row, config->width, pass->step, config->output_bytes);
+        for (int r = y + 1; r < y + pass->step && r < config->height; ++r) {
+            memcpy(pixel_ptr(args, 0, r), row, (size_t)config->width * config->output_bytes);
+        }
+    }
+}
+
+// Process block rows of a progressive pass - @next_block hands them out until cancelled
+static void run_progressive(ThreadArgs *args) {
+    const Config *config = args->config;
+    ProgressivePass *pass = args->pass;
+
+    while (!atomic_load_explicit(pass->cancel, memory_order_relaxed)) {
+        int j0 = atomic_fetch_add(&pass->next_block, pass->per_task);
+        if (j0 >= pass->nblocks) {
+            break;
+        }
+        int j1 = j0 + pass->per_task < pass->nblocks ? j0 + pass->per_task : pass->nblocks;
+
+        double t0 = config->stats ? bench_now() : 0.0;
+        for (int j = j0; j < j1; ++j) {
+            progressive_block(args, j);
+        }
+        if (config->stats) {
+            int y1 = j1 * pass->step < config->height ? j1 * pass->step : config->height;
+            record_block(args, 0, j0 * pass->step, config->width, y1, t0);
+        }
+    }
+}
+
+// Process the rows of the pan strips - @next_row hands them out
+static void run_strips(ThreadArgs *args) {
+    PanStrips *strips = args->strips;
+
+    while (true) {
+        int k0 = atomic_fetch_add(&strips->next_row, strips->chunk);
+        if (k0 >= strips->rows) {
+            break;
+        }
+        int k1 = k0 + strips->chunk;
+
+        int base = 0; // Rows of the rects before this one
+        for (int r = 0; r < strips->nrects; ++r) {
+            const PanRect *rect = &strips->rects[r];
+            int end = base + rect->y1 - rect->y0;
+            int lo = k0 > base ? k0 : base;
+            int hi = k1 < end ? k1 : end;
+            if (lo < hi) {
+                render_block(args, rect->x0, rect->y0 + lo - base, rect->x1, rect->y0 + hi - base);
+            }
+            base = end;
+        }
+    }
+}
+
+// aa=: flags pixel x of row when it differs from a 4-neighbour, inlined per width
+static inline __attribute__((always_inline))
+void mark_elements(const char *row, const char *up, const char *down, int width, uint8_t *edges,
+                   int bytes) {
+    for (int x = 0; x < width; ++x) {
+        const char *p = row + (size_t)x * bytes;
+        edges[x] = (x > 0 && memcmp(p, p - bytes, bytes) != 0) ||
+                   (x + 1 < width && memcmp(p, p + bytes, bytes) != 0) ||
+                   (up && memcmp(p, up + (size_t)x * bytes, bytes) != 0) ||
+                   (down && memcmp(p, down + (size_t)x * bytes, bytes) != 0);
+    }
+}
+
+static void aa_mark_row(ThreadArgs *args, int y) {
+    const Config *config = args->config;
+    const char *row = pixel_ptr(args, 0, y);
+    const char *up = y > 0 ? pixel_ptr(args, 0, y - 1) : NULL;
+    const char *down = y + 1 < config->height ? pixel_ptr(args, 0, y + 1) : NULL;
+    uint8_t *edges = args->aa->edges + (size_t)y * config->width;
+    switch (config->output_bytes) {
+    case 1: mark_elements(row, up, down, config->width, edges, 1); break;
+    case 2: mark_elements(row, up, down, config->width, edges, 2); break;
+    case 3: mark_elements(row, up, down, config->width, edges, 3); break;
+    default: mark_elements(row, up, down, config->width, edges, 4); break;
+    }
+}
+
+/**
+ * @brief aa=: replaces the marked pixels of row y by the mean of their samples.
+ *
+ * Runs of up to AA_RUN marked pixels are computed N sample rows at a time
+ * into the scratch block; with a palette the samples are coloured and the
+ * colours averaged, otherwise the values.
+ */
+static void aa_refine_row(ThreadArgs *args, int y) {
+    const Config *config = args->config;
+    const AaPass *aa = args->aa;
+    const uint8_t *edges = aa->edges + (size_t)y * config->width;
+    int n = aa->n, samples = n * n;
+
+    size_t len = (size_t)samples * AA_RUN;
+    if (len > args->scratch_len) {
+        free(args->scratch);
+        args->scratch = malloc(sizeof(int) * len);
+        args->scratch_len = len;
+        if (!args->scratch) {
+            perror("Failed to allocate supersampling block");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (config->colours && 3 * len > args->values_len) {
+        free(args->values);
+        args->values = malloc(3 * len);
+        args->values_len = 3 * len;
+        if (!args->values) {
+            perror("Failed to allocate supersampling block");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char *row = pixel_ptr(args, 0, y);
+    for (int a = 0; a < config->width; ++a) {
+        if (!edges[a]) {
+            continue;
+        }
+        int b = a + 1;
+        while (b < config->width && b - a < AA_RUN && edges[b]) {
+            ++b;
+        }
+        int run = (b - a) * n; // Samples per sample row
+        for (int j = 0; j < n; ++j) {
+            args->kernel32(&aa->fine, y * n + j, a * n, b * n, args->scratch + j * run,
+                           &args->stats);
+        }
+        if (config->colours) {
+            uint8_t *rgb = args->values;
+            colour_row(config->colours, args->scratch, samples * (b - a), sizeof(int), rgb);
+            for (int x = a; x < b; ++x) {
+                int sum[3] = {0, 0, 0};
+                for (int j = 0; j < n; ++j) {
+                    const uint8_t *p = rgb + 3 * ((size_t)j * run + (x - a) * n);
+                    for (int i = 0; i < 3 * n; ++i) {
+                        sum[i % 3] += p[i];
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    row[3 * (size_t)x + c] = (char)((sum[c] + samples / 2) / samples);
+                }
+            }
+        } else {
+            for (int x = a; x < b; ++x) {
+                long long sum = 0;
+                for (int j = 0; j < n; ++j) {
+                    const int *p = args->scratch + (size_t)j * run + (x - a) * n;
+                    for (int i = 0; i < n; ++i) {
+                        sum += p[i];
+                    }
+                }
+                store_iter(row, x, (int)((sum + samples / 2) / samples), config->pixel_bytes);
+            }
+        }
+        args->stats.supersampled += b - a;
+        a = b - 1;
+    }
+}
+
+// Process rows of the aa= edge pass - @next_row hands them out
+static void run_aa(ThreadArgs *args) {
+    const Config *config = args->config;
+    AaPass *aa = args->aa;
+
+    while (true) {
+        int y0 = atomic_fetch_add(&aa->next_row, aa->chunk);
+        if (y0 >= config->height) {
+            break;
+        }
+        int y1 = y0 + aa->chunk < config->height ? y0 + aa->chunk : config->height;
+
+        double t0 = config->stats ? bench_now() : 0.0;
+        for (int y = y0; y < y1; ++y) {
+            if (aa->marking) {
+                aa_mark_row(args, y);
+            } else {
+                aa_refine_row(args, y);
+            }
+        }
+        if (config->stats && !aa->marking) {
+            record_block(args, 0, y0, config->width, y1, t0);
+        }
+    }
+}
+
+// Pins this worker and/or touches the pages of its band of the buffer
+static void run_place(ThreadArgs *args) {
+    PoolPlacement *place = args->place;
+
+#ifdef __linux__
+    if (place->ncpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(place->cpus[args->id % place->ncpus], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            atomic_store(&place->failed, true);
+        }
+    }
+#endif
+    if (place->base) {
+        // The pages that start in this worker's share of the bytes
+        int n = args->config->threads;
+        size_t lo = place->size * args->id / n, hi = place->size * (args->id + 1) / n;
+        lo = (lo + place->page - 1) / place->page * place->page;
+        for (size_t offset = lo; offset < hi; offset += place->page) {
+            place->base[offset] = 0;
+        }
+    }
+}
+
+static void thread_mandelbrot(ThreadArgs *args) {
+    if (args->place) {
+        run_place(args);
+    } else if (args->aa) {
+        run_aa(args);
+    } else if (args->strips) {
+        run_strips(args);
+    } else if (args->pass) {
+        run_progressive(args);
+    } else if (args->sink) {
+        run_sink(args);
+    } else if (args->config->stream) {
+        run_stream(args);
+    } else if (args->config->sched == SCHED_TILES) {
+        run_tiles(args);
+    } else {
+        run_rows(args);
+    }
+}
+
+// Pool worker: claims a ThreadArgs slot, then runs its share of every posted frame
+static void *pool_worker(void *arg) {
+    RenderPool *pool = (RenderPool *)arg;
+    long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    ThreadArgs *args = &pool->args[pool->started++];
+    while (true) {
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        thread_mandelbrot(args);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+RenderPool *render_pool_create(int threads) {
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+
+    RenderPool *pool = malloc(sizeof(RenderPool));
+    if (!pool) {
+        perror("Failed to allocate thread pool");
+        exit(EXIT_FAILURE);
+    }
+    pool->nthreads = threads;
+    pool->threads = malloc(sizeof(pthread_t) * threads);
+    pool->args = calloc(threads, sizeof(ThreadArgs));
+    pool->deques = aligned_alloc(CACHE_LINE, sizeof(TileDeque) * threads);
+    if (!pool->threads || !pool->args || !pool->deques) {
+        perror("Failed to allocate thread pool");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->generation = 0;
+    pool->running = 0;
+    pool->started = 0;
+    pool->shutdown = false;
+    pool->gpu = NULL;
+    pool->gpu_tried = false;
+    pool->colours = NULL;
+    atomic_init(&pool->cancel, false);
+
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&pool->threads[i], NULL, pool_worker, pool);
+    }
+    return pool;
+}
+
+void render_pool_destroy(RenderPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->threads[i], NULL);
+        free(pool->args[i].scratch);
+        free(pool->args[i].values);
+        free(pool->args[i].band);
+        histogram_free(pool->args[i].histogram);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    if (pool->gpu) {
+        gpu_close(pool->gpu);
+    }
+    colour_map_free(pool->colours);
+    free(pool->deques);
+    free(pool->args);
+    free(pool->threads);
+    free(pool);
+}
+
+int render_pool_threads(const RenderPool *pool) {
+    return pool->nthreads;
+}
+
+/**
+ * @brief stats=1: prints one line per worker and a load-imbalance summary to stderr.
+ *
+ * Idle time is the frame wall time minus the time spent rendering: waiting
+ * for work, stealing, waiting for stream slots and idling after the last
+ * task. The finish spread is the gap between the first and the last worker
+ * running out of work; a large spread points at chunks or tiles that are
+ * too coarse.
+ * @param args The joined workers.
+ * @param nthreads The number of workers.
+ * @param wall Frame wall time in seconds.
+ */
+static void print_worker_stats(const ThreadArgs *args, int nthreads, double wall) {
+    double busy_sum = 0.0, busy_max = 0.0;
+    double last_min = wall, last_max = 0.0;
+    long long iter_sum = 0, iter_max = 0;
+
+    fprintf(stderr, "thread      tasks       rows     pixels     iterations   busy ms   idle ms"
+                    "   last ms   steals\n");
+    for (int i = 0; i < nthreads; ++i) {
+        const WorkerStats *work = &args[i].work;
+        fprintf(stderr, "%6d %10lld %10lld %10lld %14lld %9.2f %9.2f %9.2f %8lld\n",
+                i, work->tasks, work->rows, work->pixels, args[i].stats.iterations, work->busy * 1e3,
+                (wall - work->busy) * 1e3, work->last * 1e3, work->steals);
+        busy_sum += work->busy;
+        busy_max = work->busy > busy_max ? work->busy : busy_max;
+        last_min = work->last < last_min ? work->last : last_min;
+        last_max = work->last > last_max ? work->last : last_max;
+        iter_sum += args[i].stats.iterations;
+        iter_max = args[i].stats.iterations > iter_max ? args[i].stats.iterations : iter_max;
+    }
+
+    double busy_mean = busy_sum / nthreads;
+    double iter_mean = (double)iter_sum / nthreads;
+    fprintf(stderr, "Load imbalance: busy max/mean %.3f, iterations max/mean %.3f, "
+                    "finish spread %.2f ms of %.2f ms wall, %.1f%% of worker time idle\n",
+            busy_mean > 0.0 ? busy_max / busy_mean : 1.0,
+            iter_mean > 0.0 ? iter_max / iter_mean : 1.0,
+            (last_max - last_min) * 1e3, wall * 1e3,
+            wall > 0.0 ? 100.0 * (1.0 - busy_mean / wall) : 0.0);
+}
+
+// Writer side of the band ring: hands each band to fn in order, then frees its slot
+static void stream_consume(const Config *config, StreamRing *ring, band_fn fn, void *ctx) {
+    size_t stride = (size_t)config->width * config->output_bytes;
+
+    for (int b = 0; b < ring->nbands; ++b) {
+        StreamSlot *slot = &ring->slots[b % ring->nslots];
+        pthread_mutex_lock(&ring->lock);
+        while (slot->band != b || !slot->done) {
+            pthread_cond_wait(&ring->band_done, &ring->lock);
+        }
+        pthread_mutex_unlock(&ring->lock);
+
+        int y_lo, rows;
+        stream_band_rows(config, ring, b, &y_lo, &rows);
+        fn(ctx, y_lo, rows, slot->rows, stride);
+
+        pthread_mutex_lock(&ring->lock);
+        slot->done = false;
+        slot->band = b + ring->nslots;
+        pthread_cond_broadcast(&ring->slot_free);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/**
+ * @brief Runs one frame on the pool's workers.
+ *
+ * With stream set, the calling thread passes the bands to fn while the
+ * workers compute them; otherwise the frame lands in proto->output_buffer.
+ * @param pool The pool; its size is proto->config->threads.
+ * @param proto Template for the per-thread arguments (id, sched,
+ *        next_y, scratch, counts and stats are filled in here).
+ * @param fn, ctx The band consumer (stream only).
+ * @param stats Accumulates the kernel counters of all threads, and their
+ *        histograms into stats->histogram when it is set.
+ */
+static void run_frame(RenderPool *pool, const ThreadArgs *proto, band_fn fn, void *ctx,
+                      KernelStats *stats) {
+    const Config *config = proto->config;
+    ThreadArgs *args = pool->args;
+    TileScheduler sched;
+    tile_scheduler_init(&sched, config, pool->deques);
+    atomic_int next_y;
+    atomic_init(&next_y, 0);
+    double frame_start = bench_now();
+
+    for (int i = 0; i < pool->nthreads; ++i) {
+        int *scratch = args[i].scratch; // kept across frames
+        size_t scratch_len = args[i].scratch_len;
+        void *values = args[i].values;
+        size_t values_len = args[i].values_len;
+        void *band = args[i].band;
+        size_t band_len = args[i].band_len;
+        Histogram *histogram = args[i].histogram;
+        if (stats->histogram) {
+            if (histogram) {
+                histogram_reset(histogram, stats->histogram->value_max);
+            } else {
+                histogram = histogram_create(stats->histogram->value_max);
+            }
+        }
+        args[i] = *proto;
+        args[i].id = i;
+        args[i].sched = &sched;
+        args[i].next_y = &next_y;
+        args[i].buffer_y0 = proto->buffer_y0;
+        args[i].scratch = scratch;
+        args[i].scratch_len = scratch_len;
+        args[i].values = values;
+        args[i].values_len = values_len;
+        args[i].band = band;
+        args[i].band_len = band_len;
+        args[i].histogram = histogram;
+        args[i].counts = stats->histogram ? histogram : NULL;
+        args[i].stats = (KernelStats){0};
+        args[i].work = (WorkerStats){0};
+        args[i].frame_start = frame_start;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->nthreads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (config->stream) {
+        stream_consume(config, proto->ring, fn, ctx);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; ++i) {
+        stats->periodic += args[i].stats.periodic;
+        stats->filled += args[i].stats.filled;
+        stats->rebases += args[i].stats.rebases;
+        stats->iterations += args[i].stats.iterations;
+        stats->supersampled += args[i].stats.supersampled;
+        if (args[i].counts) {
+            histogram_merge(stats->histogram, args[i].counts);
+        }
+    }
+    if (config->stats) {
+        print_worker_stats(args, pool->nthreads, bench_now() - frame_start);
+    }
+}
+
+// Runs place on every worker of pool
+static void run_placement(RenderPool *pool, PoolPlacement *place) {
+    Config config = config_default();
+    config.threads = pool->nthreads;
+    ThreadArgs proto = {.config = &config, .place = place};
+    run_frame(pool, &proto, NULL, NULL, &(KernelStats){0});
+}
+
+bool render_pool_pin(RenderPool *pool) {
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return false;
+    }
+    int cpus[CPU_SETSIZE];
+    int ncpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[ncpus++] = cpu;
+        }
+    }
+    if (ncpus == 0) {
+        return false;
+    }
+    PoolPlacement place = {.cpus = cpus, .ncpus = ncpus};
+    atomic_init(&place.failed, false);
+    run_placement(pool, &place);
+    return !atomic_load(&place.failed);
+#else
+    (void)pool;
+    return false;
+#endif
+}
+
+// Bytes mapped for a render_pool_alloc() buffer of size bytes
+static size_t mapping_size(size_t size, bool huge) {
+    size_t page = huge ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    size = size > 0 ? size : 1;
+    return (size + page - 1) / page * page;
+}
+
+void *render_pool_alloc(RenderPool *pool, size_t size, bool huge) {
+    size_t len = mapping_size(size, huge);
+    void *buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge) {
+        // Fails unless huge pages are reserved (vm.nr_hugepages)
+        buffer = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                      -1, 0);
+    }
+#endif
+    if (buffer == MAP_FAILED) {
+        buffer = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            perror("Failed to allocate result buffer");
+            exit(EXIT_FAILURE);
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge) {
+            madvise(buffer, len, MADV_HUGEPAGE); // A hint: ignored where THP is disabled
+        }
+#endif
+    }
+
+    PoolPlacement place = {
+        .base = buffer,
+        .size = size,
+        .page = huge ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE)
+    };
+    atomic_init(&place.failed, false);
+    run_placement(pool, &place);
+    return buffer;
+}
+
+void render_pool_free(void *buffer, size_t size, bool huge) {
+    if (buffer) {
+        munmap(buffer, mapping_size(size, huge));
+    }
+}
+
+/**
+ * @brief Resolves the derived fields of the render's private Config copy
+ * and picks its kernels.
+ * @param config The copy; threads, chunk, pixel_bytes, output_bytes,
+ *        x_step, colours and orbit are set.
+ * @param pool The pool that will run the render; threads is its size, and
+ *        it keeps the colour table.
+ * @param proto Receives the config and kernels.
+ * @return The reference orbit to free after the render (engine=perturb), or NULL.
+ */
+static PerturbOrbit *render_setup(Config *config, RenderPool *pool, ThreadArgs *proto) {
+    config->threads = pool->nthreads;
+    if (config->chunk <= 0) {
+        config->chunk = auto_chunk_size(config);
+    }
+    config->pixel_bytes = config_pixel_bytes(config);
+    config->output_bytes = config_output_bytes(config);
+    config->x_step = 1;
+    config->colours = NULL;
+    if (config_rgb(config)) {
+        ColourMap *map = pool->colours;
+        if (!map || map->palette != config->palette || map->value_max != config_value_max(config)) {
+            colour_map_free(map);
+            map = pool->colours = colour_map_create(config->palette, config_value_max(config));
+        }
+        config->colours = map;
+    }
+    config->orbit = NULL;
+    config->precision = resolve_precision(config);
+    config->ll_x_long = config->ll_x_str ? strtold(config->ll_x_str, NULL) : config->ll_x;
+    config->ll_y_long = config->ll_y_str ? strtold(config->ll_y_str, NULL) : config->ll_y;
+    config->ur_x_long = config->ur_x_str ? strtold(config->ur_x_str, NULL) : config->ur_x;
+    config->ur_y_long = config->ur_y_str ? strtold(config->ur_y_str, NULL) : config->ur_y;
+
+    *proto = (ThreadArgs){
+        .config = config,
+        .kernel = select_row_kernel(config, config->pixel_bytes),
+        .kernel32 = select_row_kernel(config, sizeof(int)),
+        .pixel_kernel = config->precision == PRECISION_FLOAT ? escape_row_scalar_float_u32 :
+                        config->precision == PRECISION_LONG ? escape_row_scalar_long_u32 :
+                        config->smooth ? escape_row_scalar_smooth_u32 :
+                        escape_row_scalar_u32
+    };
+
+    PerturbOrbit *orbit = NULL;
+    if (config->engine == ENGINE_PERTURB) {
+        orbit = perturb_orbit_build(config);
+        config->orbit = orbit;
+        proto->kernel = ROW_KERNEL_FOR(perturb_row, config->pixel_bytes);
+        proto->kernel32 = proto->pixel_kernel = perturb_row_u32;
+    }
+    return orbit;
+}
+
+// Adds a frame's counters to the caller's (which may be NULL)
+static void render_finish(PerturbOrbit *orbit, const KernelStats *frame, KernelStats *stats) {
+    if (stats) {
+        stats->periodic += frame->periodic;
+        stats->filled += frame->filled;
+        stats->rebases += frame->rebases;
+        stats->iterations += frame->iterations;
+        stats->reused += frame->reused;
+        stats->supersampled += frame->supersampled;
+        if (orbit) {
+            stats->orbit_len = orbit->len;
+        }
+    }
+    perturb_orbit_free(orbit);
+}
+
+// The pool's GPU, opened on first use; NULL (after one warning) if there is none
+static GpuContext *pool_gpu(RenderPool *pool) {
+    if (!pool->gpu_tried) {
+        const char *reason = "";
+        pool->gpu_tried = true;
+        pool->gpu = gpu_open(&reason);
+        if (!pool->gpu) {
+            fprintf(stderr, "Warning: engine=gpu: %s, rendering on the CPU\n", reason);
+        }
+    }
+    return pool->gpu;
+}
+
+// Drops a device that failed a render; later frames go to the CPU
+static void pool_gpu_failed(RenderPool *pool, const char *reason) {
+    fprintf(stderr, "Warning: engine=gpu: %s, rendering on the CPU\n", reason);
+    gpu_close(pool->gpu);
+    pool->gpu = NULL;
+}
+
+/**
+ * @brief engine=gpu stream: renders band by band on the device and passes each to fn.
+ *
+ * With a palette, each band is coloured on the calling thread on its way
+ * from the device to fn; with histogram set, it is counted there too.
+ * @return false if the device failed before the first band, so the caller
+ *         can render the whole frame on the CPU; exits on a later failure.
+ */
+static bool gpu_bands(RenderPool *pool, const Config *config, bool bottom_up, band_fn fn,
+                      void *ctx, Histogram *histogram) {
+    int band_rows = config->band > 0 ? config->band : config->chunk;
+    size_t stride = (size_t)config->width * config->pixel_bytes;
+    size_t rgb_stride = (size_t)config->width * 3;
+    void *rows = malloc(stride * band_rows);
+    uint8_t *rgb = config->colours ? malloc(rgb_stride * band_rows) : NULL;
+    if (!rows || (config->colours && !rgb)) {
+        perror("Failed to allocate band buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int r0 = 0; r0 < config->height; r0 += band_rows) {
+        int r1 = r0 + band_rows < config->height ? r0 + band_rows : config->height;
+        int y_lo = bottom_up ? config->height - r1 : r0;
+        const char *reason = "";
+        if (!gpu_render_rows(pool->gpu, config, y_lo, r1 - r0, rows, stride, &reason)) {
+            if (r0 > 0) {
+                fprintf(stderr, "Error: engine=gpu: %s after %d rows\n", reason, r0);
+                exit(EXIT_FAILURE);
+            }
+            pool_gpu_failed(pool, reason);
+            free(rows);
+            free(rgb);
+            return false;
+        }
+        for (int r = 0; histogram && r < r1 - r0; ++r) {
+            histogram_add(histogram, (const char *)rows + r * stride, config->width,
+                          config->pixel_bytes);
+        }
+        if (config->colours) {
+            for (int r = 0; r < r1 - r0; ++r) {
+                colour_row(config->colours, (const char *)rows + r * stride, config->width,
+                           config->pixel_bytes, rgb + r * rgb_stride);
+            }
+            fn(ctx, y_lo, r1 - r0, rgb, rgb_stride);
+        } else {
+            fn(ctx, y_lo, r1 - r0, rows, stride);
+        }
+    }
+    free(rows);
+    free(rgb);
+    return true;
+}
+
+typedef struct {
+    void *out;
+    size_t stride;
+} FrameCopy;
+
+// gpu_bands() consumer for render_pool_frame(): copies each band into the frame
+static void copy_band(void *ctx, int y_lo, int rows, const void *data, size_t stride) {
+    FrameCopy *copy = ctx;
+    for (int r = 0; r < rows; ++r) {
+        memcpy((char *)copy->out + (size_t)(y_lo + r) * copy->stride,
+               (const char *)data + r * stride, stride);
+    }
+}
+
+/**
+ * @brief aa=N: supersamples the edge pixels of the frame in proto->output_buffer.
+ *
+ * Two runs on the pool: one marks the edges, the other recomputes them
+ * (see AaPass). Only a flag per pixel and the workers' AA_RUN sample
+ * blocks are allocated, never the frame at N times the resolution. The
+ * samples always come from the CPU kernels, also after engine=gpu.
+ */
+static void supersample_edges(RenderPool *pool, const ThreadArgs *proto, KernelStats *frame) {
+    const Config *config = proto->config;
+    int n = config->aa;
+    AaPass aa = {.n = n, .marking = true, .fine = *config};
+    aa.edges = malloc((size_t)config->width * config->height);
+    if (!aa.edges) {
+        perror("Failed to allocate edge flags");
+        exit(EXIT_FAILURE);
+    }
+
+    // Half a sample in from the pixel's corner, in the double and long double views
+    // (engine=perturb measures from the orbit at the view centre, so its samples stay on the corners)
+    Config *fine = &aa.fine;
+    double dx = (config->ur_x - config->ll_x) / config->width / (2 * n);
+    double dy = (config->ur_y - config->ll_y) / config->height / (2 * n);
+    long double dx_long = (config->ur_x_long - config->ll_x_long) / config->width / (2 * n);
+    long double dy_long = (config->ur_y_long - config->ll_y_long) / config->height / (2 * n);
+    fine->width = config->width * n;
+    fine->height = config->height * n;
+    fine->ll_x += dx;
+    fine->ur_x += dx;
+    fine->ll_y -= dy;
+    fine->ur_y -= dy;
+    fine->ll_x_long += dx_long;
+    fine->ur_x_long += dx_long;
+    fine->ll_y_long -= dy_long;
+    fine->ur_y_long -= dy_long;
+
+    ThreadArgs job = *proto;
+    job.aa = &aa;
+    for (int pass = 0; pass < 2; ++pass) {
+        aa.marking = pass == 0;
+        aa.chunk = config->chunk;
+        atomic_init(&aa.next_row, 0);
+        run_frame(pool, &job, NULL, NULL, frame);
+    }
+    free(aa.edges);
+}
+
+void render_pool_frame(RenderPool *pool, const Config *config, void *out, size_t stride,
+                       KernelStats *stats) {
+    Config job = *config;
+    job.stream = false;
+    ThreadArgs proto;
+    PerturbOrbit *orbit = render_setup(&job, pool, &proto);
+    proto.output_buffer = out;
+    proto.stride = stride;
+
+    KernelStats frame = {.histogram = stats ? stats->histogram : NULL};
+    bool done = false;
+    if (job.engine == ENGINE_GPU && pool_gpu(pool)) {
+        if (job.colours) {
+            // The device returns values; colour them band by band on the way in
+            done = gpu_bands(pool, &job, false, copy_band, &(FrameCopy){out, stride},
+                             frame.histogram);
+        } else {
+            const char *reason = "";
+            done = gpu_render_rows(pool->gpu, &job, 0, job.height, out, stride, &reason);
+            if (!done) {
+                pool_gpu_failed(pool, reason);
+            }
+            for (int y = 0; done && frame.histogram && y < job.height; ++y) {
+                histogram_add(frame.histogram, (const char *)out + y * stride, job.width,
+                              job.pixel_bytes);
+            }
+        }
+    }
+    if (!done) {
+        run_frame(pool, &proto, NULL, NULL, &frame);
+    }
+    if (job.aa > 1) {
+        supersample_edges(pool, &proto, &frame);
+    }
+    render_finish(orbit, &frame, stats);
+}
+
+void render_pool_bands(RenderPool *pool, const Config *config, bool bottom_up, band_fn fn,
+                       void *ctx, KernelStats *stats) {
+    Config job = *config;
+    job.stream = true;
+    ThreadArgs proto;
+    PerturbOrbit *orbit = render_setup(&job, pool, &proto);
+    KernelStats frame = {.histogram = stats ? stats->histogram : NULL};
+    if (job.engine == ENGINE_GPU && pool_gpu(pool) &&
+        gpu_bands(pool, &job, bottom_up, fn, ctx, frame.histogram)) {
+        render_finish(orbit, &(KernelStats){0}, stats);
+        return;
+    }
+    StreamRing ring;
+    stream_ring_init(&ring, &job, bottom_up);
+    proto.ring = &ring;
+
+    run_frame(pool, &proto, fn, ctx, &frame);
+    stream_ring_free(&ring);
+    render_finish(orbit, &frame, stats);
+}
+
+void render_pool_rows(RenderPool *pool, const Config *config, band_fn fn, void *ctx,
+                      KernelStats *stats) {
+    Config job = *config;
+    job.stream = false;
+    ThreadArgs proto;
+    PerturbOrbit *orbit = render_setup(&job, pool, &proto);
+    KernelStats frame = {.histogram = stats ? stats->histogram : NULL};
+    if (job.engine == ENGINE_GPU && pool_gpu(pool) &&
+        gpu_bands(pool, &job, false, fn, ctx, frame.histogram)) {
+        render_finish(orbit, &(KernelStats){0}, stats);
+        return;
+    }
+    proto.sink = fn;
+    proto.sink_ctx = ctx;
+
+    run_frame(pool, &proto, NULL, NULL, &frame);
+    render_finish(orbit, &frame, stats);
+}
+
+/**
+ * @brief The whole-pixel shift from prev's view to config's.
+ * @param dx Receives the columns the view moved right.
+ * @param dy Receives the rows the view moved down.
+ * @return false unless the frames differ by such a shift alone and still overlap.
+ */
+static bool pan_offset(const Config *prev, const Config *config, int *dx, int *dy) {
+    if (prev->width != config->width || prev->height != config->height ||
+        prev->max_iter != config->max_iter || prev->smooth != config->smooth ||
+        prev->precision != config->precision || prev->engine != config->engine ||
+        prev->algo != config->algo || prev->simd != config->simd ||
+        prev->period != config->period || prev->interior != config->interior ||
+        prev->unroll != config->unroll || prev->palette != config->palette ||
+        prev->aa > 1 || config->aa > 1 ||
+        config_output_bytes(prev) != config_output_bytes(config)) {
+        return false;
+    }
+    double px = (config->ur_x - config->ll_x) / config->width;
+    double py = (config->ur_y - config->ll_y) / config->height;
+    double magnitude = fmax(fmax(fabs(config->ll_x), fabs(config->ur_x)),
+                            fmax(fmax(fabs(config->ll_y), fabs(config->ur_y)), 2.0));
+    if (!(fmin(px, py) > magnitude * DBL_EPSILON * PRECISION_MARGIN)) {
+        return false; // the doubles cannot place the views to a fraction of a pixel
+    }
+    // Both corners move by the same whole number of pixels, so the scale is unchanged
+    double lx = (config->ll_x - prev->ll_x) / px, ux = (config->ur_x - prev->ur_x) / px;
+    double uy = (prev->ur_y - config->ur_y) / py, ly = (prev->ll_y - config->ll_y) / py;
+    if (!(fabs(lx) < config->width && fabs(uy) < config->height)) {
+        return false;
+    }
+    *dx = (int)lround(lx);
+    *dy = (int)lround(uy);
+    return fabs(lx - *dx) < PAN_TOLERANCE && fabs(ux - *dx) < PAN_TOLERANCE &&
+           fabs(uy - *dy) < PAN_TOLERANCE && fabs(ly - *dy) < PAN_TOLERANCE &&
+           abs(*dx) < config->width && abs(*dy) < config->height;
+}
+
+// Moves the pixels that stay in view: new (x, y) is old (x + dx, y + dy)
+static void shift_frame(void *out, size_t stride, int width, int height, int bytes, int dx,
+                        int dy) {
+    size_t len = (size_t)(width - abs(dx)) * bytes;
+    size_t to = dx < 0 ? (size_t)-dx * bytes : 0, from = dx > 0 ? (size_t)dx * bytes : 0;
+    int rows = height - abs(dy);
+    // Rows move towards their destination in an order that never overwrites a source
+    for (int r = 0; r < rows; ++r) {
+        int y = dy > 0 ? r : height - 1 - r;
+        char *row = (char *)out + (size_t)y * stride;
+        memmove(row + to, (char *)out + (size_t)(y + dy) * stride + from, len);
+    }
+}
+
+bool render_pool_pan(RenderPool *pool, const Config *prev, const Config *config, void *out,
+                     size_t stride, KernelStats *stats) {
+    int dx, dy;
+    // engine=perturb: the new view has its own reference orbit, which the reused pixels lack
+    if (config->engine == ENGINE_GPU || config->engine == ENGINE_PERTURB ||
+        (stats && stats->histogram) || !pan_offset(prev, config, &dx, &dy)) {
+        render_pool_frame(pool, config, out, stride, stats);
+        return false;
+    }
+    Config job = *config;
+    job.stream = false;
+    ThreadArgs proto;
+    PerturbOrbit *orbit = render_setup(&job, pool, &proto);
+    shift_frame(out, stride, job.width, job.height, job.output_bytes, dx, dy);
+
+    PanStrips strips = {.nrects = 0};
+    int kept_y0 = dy < 0 ? -dy : 0, kept_y1 = dy > 0 ? job.height - dy : job.height;
+    if (dy != 0) {
+        strips.rects[strips.nrects++] = dy > 0 ? (PanRect){0, kept_y1, job.width, job.height}
+                                               : (PanRect){0, 0, job.width, kept_y0};
+    }
+    if (dx != 0) {
+        strips.rects[strips.nrects++] = dx > 0 ? (PanRect){job.width - dx, kept_y0, job.width, kept_y1}
+                                               : (PanRect){0, kept_y0, -dx, kept_y1};
+    }
+    for (int r = 0; r < strips.nrects; ++r) {
+        strips.rows += strips.rects[r].y1 - strips.rects[r].y0;
+    }
+    strips.chunk = strips.rows / (job.threads * TASKS_PER_THREAD);
+    strips.chunk = strips.chunk > 1 ? strips.chunk : 1;
+    atomic_init(&strips.next_row, 0);
+
+    KernelStats frame = {.reused = (long long)(job.width - abs(dx)) * (job.height - abs(dy))};
+    if (strips.nrects > 0) {
+        proto.output_buffer = out;
+        proto.stride = stride;
+        proto.strips = &strips;
+        run_frame(pool, &proto, NULL, NULL, &frame);
+    }
+    render_finish(orbit, &frame, stats);
+    return true;
+}
+
+void render_pool_region(RenderPool *pool, const Config *config, int y_lo, int rows, void *out,
+                        size_t stride, KernelStats *stats) {
+    Config job = *config;
+    job.stream = false;
+    ThreadArgs proto;
+    PerturbOrbit *orbit = render_setup(&job, pool, &proto);
+
+    PanStrips strips = {.nrects = 1, .rects = {{0, y_lo, job.width, y_lo + rows}}, .rows = rows};
+    strips.chunk = rows / (job.threads * TASKS_PER_THREAD);
+    strips.chunk = strips.chunk > job.chunk ? job.chunk : strips.chunk > 1 ? strips.chunk : 1;
+    atomic_init(&strips.next_row, 0);
+    proto.output_buffer = out;
+    proto.stride = stride;
+    proto.buffer_y0 = y_lo;
+    proto.strips = &strips;
+
+    KernelStats frame = {.histogram = stats ? stats->histogram : NULL};
+    run_frame(pool, &proto, NULL, NULL, &frame);
+    render_finish(orbit, &frame, stats);
+}
+
+bool render_pool_progressive(RenderPool *pool, const Config *config, void *out, size_t stride,
+                             pass_fn fn, void *ctx, KernelStats *stats) {
+    Config job = *config;
+    job.stream = false;
+    ThreadArgs proto;
+    PerturbOrbit *orbit = render_setup(&job, pool, &proto);
+    proto.output_buffer = out;
+    proto.stride = stride;
+    atomic_store(&pool->cancel, false);
+
+    KernelStats frame = {.histogram = stats ? stats->histogram : NULL};
+    bool complete = true;
+    for (int step = PROGRESSIVE_STEP; step >= 1; step /= 2) {
+        ProgressivePass pass = {
+            .step = step,
+            .first = step == PROGRESSIVE_STEP,
+            .dense = job,
+            .sparse = job,
+            .nblocks = (job.height + step - 1) / step,
+            .per_task = job.chunk / step > 1 ? job.chunk / step : 1,
+            .cancel = &pool->cancel
+        };
+        pass.dense.x_step = step;
+        pass.sparse.x_step = 2 * step;
+        atomic_init(&pass.next_block, 0);
+        proto.pass = &pass;
+
+        run_frame(pool, &proto, NULL, NULL, &frame);
+        if (atomic_load(&pool->cancel)) {
+            complete = false;
+            break;
+        }
+        if (fn) {
+            fn(ctx, step, out, stride);
+        }
+    }
+    render_finish(orbit, &frame, stats);
+    return complete;
+}
+
+void render_pool_cancel(RenderPool *pool) {
+    atomic_store(&pool->cancel, true);
+}
+
+void render(const Config *config, void *out, size_t stride, KernelStats *stats) {
+    RenderPool *pool = render_pool_create(config->threads);
+    render_pool_frame(pool, config, out, stride, stats);
+    render_pool_destroy(pool);
+}
+
+void render_bands(const Config *config, bool bottom_up, band_fn fn, void *ctx,
+                  KernelStats *stats) {
+    RenderPool *pool = render_pool_create(config->threads);
+    render_pool_bands(pool, config, bottom_up, fn, ctx, stats);
+    render_pool_destroy(pool);
+}
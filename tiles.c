@@ -0,0 +1,426 @@
+/**
+ * @file tiles.c
+ * @brief pyramid=1: z/x/y tiles with a memory LRU and an on-disk cache; see mandelbrot.h.
+ *
+ * A view is assembled from the tiles of one pyramid level, so panning or
+ * returning to a view only computes the tiles no cache holds yet. Each
+ * missing tile is rendered as one PYRAMID_TILE x PYRAMID_TILE frame on the
+ * pool, always from its own corners, so a tile has the same values however
+ * it was first reached.
+ */
+
+#define _POSIX_C_SOURCE 200809L // mkstemp() under -std=c23
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mandelbrot.h"
+#include "palette.h"
+
+#define TILE_PIXELS ((size_t)PYRAMID_TILE * PYRAMID_TILE)
+
+typedef struct {
+    int z;
+    long long x, y;
+    int max_iter;
+    Precision precision;
+    Engine engine;
+    Algorithm algo;
+    bool interior;
+    bool period;
+    bool smooth;
+} TileKey;
+
+typedef struct TileEntry {
+    TileKey key;
+    struct TileEntry *newer, *older; // LRU list
+    struct TileEntry *chain;         // Next entry in the hash bucket
+    int bytes;                       // Element width of values
+    void *values;
+} TileEntry;
+
+struct TileCache {
+    pthread_mutex_t lock;
+    int capacity;
+    int count;
+    TileEntry **buckets;
+    size_t nbuckets;    // A power of two, at least twice the capacity
+    TileEntry *newest;  // Most recently used
+    TileEntry *oldest;  // Evicted first
+    char *dir;          // NULL = no disk cache
+    atomic_bool disk_failed; // A tile could not be written; later writes are skipped
+};
+
+static const char *const precision_names[] = {
+    [PRECISION_AUTO] = "auto", [PRECISION_FLOAT] = "float",
+    [PRECISION_DOUBLE] = "double", [PRECISION_LONG] = "long"
+};
+static const char *const engine_names[] = {
+    [ENGINE_DOUBLE] = "double", [ENGINE_PERTURB] = "perturb", [ENGINE_GPU] = "gpu"
+};
+static const char *const algo_names[] = {
+    [ALGO_ESCAPE] = "escape", [ALGO_MARIANI] = "mariani"
+};
+
+static TileKey tile_key(const Config *config, int z, long long x, long long y) {
+    return (TileKey){.z = z, .x = x, .y = y, .max_iter = config->max_iter,
+                     .precision = config->precision, .engine = config->engine,
+                     .algo = config->algo, .interior = config->interior,
+                     .period = config->period, .smooth = config->smooth};
+}
+
+static bool key_equal(const TileKey *a, const TileKey *b) {
+    return a->z == b->z && a->x == b->x && a->y == b->y && a->max_iter == b->max_iter &&
+           a->precision == b->precision && a->engine == b->engine && a->algo == b->algo &&
+           a->interior == b->interior && a->period == b->period && a->smooth == b->smooth;
+}
+
+static size_t key_hash(const TileKey *key) {
+    uint64_t h = (uint64_t)key->x * 0x9e3779b97f4a7c15u;
+    h ^= (uint64_t)key->y * 0xc2b2ae3d27d4eb4fu + (h << 6) + (h >> 2);
+    h ^= ((uint64_t)key->z << 40 | (uint64_t)key->max_iter << 8 | (uint64_t)key->engine << 6 |
+          (uint64_t)key->precision << 4 | (uint64_t)key->algo << 3 | (uint64_t)key->interior << 2 |
+          (uint64_t)key->period << 1 | key->smooth) * 0x165667b19e3779f9u;
+    return (size_t)(h ^ h >> 29);
+}
+
+TileCache *tile_cache_create(int capacity, const char *dir) {
+    TileCache *cache = calloc(1, sizeof(TileCache));
+    if (!cache) {
+        perror("Failed to allocate tile cache");
+        exit(EXIT_FAILURE);
+    }
+    cache->capacity = capacity > 0 ? capacity : 1;
+    cache->nbuckets = 16;
+    while (cache->nbuckets < 2 * (size_t)cache->capacity) {
+        cache->nbuckets *= 2;
+    }
+    cache->buckets = calloc(cache->nbuckets, sizeof(TileEntry *));
+    cache->dir = dir ? strdup(dir) : NULL;
+    if (!cache->buckets || (dir && !cache->dir)) {
+        perror("Failed to allocate tile cache");
+        exit(EXIT_FAILURE);
+    }
+    if (dir && mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void tile_cache_destroy(TileCache *cache) {
+    for (TileEntry *e = cache->newest, *next; e; e = next) {
+        next = e->older;
+        free(e->values);
+        free(e);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache->dir);
+    free(cache);
+}
+
+// Unlinks e from the LRU list
+static void lru_unlink(TileCache *cache, TileEntry *e) {
+    *(e->newer ? &e->newer->older : &cache->newest) = e->older;
+    *(e->older ? &e->older->newer : &cache->oldest) = e->newer;
+}
+
+static void lru_push(TileCache *cache, TileEntry *e) {
+    e->newer = NULL;
+    e->older = cache->newest;
+    *(cache->newest ? &cache->newest->newer : &cache->oldest) = e;
+    cache->newest = e;
+}
+
+// The entry for key, made the most recent; lock held
+static TileEntry *cache_find(TileCache *cache, const TileKey *key) {
+    for (TileEntry *e = cache->buckets[key_hash(key) & (cache->nbuckets - 1)]; e; e = e->chain) {
+        if (key_equal(&e->key, key)) {
+            lru_unlink(cache, e);
+            lru_push(cache, e);
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Adds a copy of values under key, evicting the oldest tile when full; lock held
+static void cache_insert(TileCache *cache, const TileKey *key, const void *values, int bytes) {
+    if (cache_find(cache, key)) {
+        return; // another thread rendered it meanwhile
+    }
+    TileEntry *e = NULL;
+    if (cache->count == cache->capacity) {
+        e = cache->oldest;
+        lru_unlink(cache, e);
+        TileEntry **link = &cache->buckets[key_hash(&e->key) & (cache->nbuckets - 1)];
+        while (*link != e) {
+            link = &(*link)->chain;
+        }
+        *link = e->chain;
+        if (e->bytes != bytes) {
+            free(e->values);
+            e->values = NULL;
+        }
+    } else {
+        e = calloc(1, sizeof(TileEntry));
+        if (!e) {
+            perror("Failed to allocate tile");
+            exit(EXIT_FAILURE);
+        }
+        ++cache->count;
+    }
+    if (!e->values && !(e->values = malloc(TILE_PIXELS * bytes))) {
+        perror("Failed to allocate tile");
+        exit(EXIT_FAILURE);
+    }
+    e->key = *key;
+    e->bytes = bytes;
+    memcpy(e->values, values, TILE_PIXELS * bytes);
+    TileEntry **bucket = &cache->buckets[key_hash(key) & (cache->nbuckets - 1)];
+    e->chain = *bucket;
+    *bucket = e;
+    lru_push(cache, e);
+}
+
+// dir/z/x/y-max_iter-precision-engine-algo[-nointerior][-period][-smooth].tile, or its
+// directory with file = false
+static void tile_path(const TileCache *cache, const TileKey *key, bool file, char *path,
+                      size_t size) {
+    if (!file) {
+        snprintf(path, size, "%s/%d/%lld", cache->dir, key->z, key->x);
+        return;
+    }
+    snprintf(path, size, "%s/%d/%lld/%lld-%d-%s-%s-%s%s%s%s.tile", cache->dir, key->z, key->x,
+             key->y, key->max_iter, precision_names[key->precision], engine_names[key->engine],
+             algo_names[key->algo], key->interior ? "" : "-nointerior",
+             key->period ? "-period" : "", key->smooth ? "-smooth" : "");
+}
+
+// Reads the tile from the disk cache; false if it is missing or truncated
+static bool disk_read(const TileCache *cache, const TileKey *key, void *out, int bytes) {
+    char path[4096];
+    tile_path(cache, key, true, path, sizeof(path));
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        return false;
+    }
+    bool ok = fread(out, bytes, TILE_PIXELS, in) == TILE_PIXELS && fgetc(in) == EOF;
+    fclose(in);
+    return ok;
+}
+
+/**
+ * @brief Writes the tile to the disk cache.
+ *
+ * The file is written under a temporary name and renamed into place, so
+ * readers in other processes never see a partial tile. On the first
+ * failure a warning is printed and the disk cache becomes read-only.
+ */
+static void disk_write(TileCache *cache, const TileKey *key, const void *values, int bytes) {
+    char path[4096], tmp[4200];
+    tile_path(cache, key, false, path, sizeof(path));
+    *strrchr(path, '/') = '\0';
+    mkdir(path, 0777); // dir/z
+    tile_path(cache, key, false, path, sizeof(path));
+    mkdir(path, 0777); // dir/z/x
+    tile_path(cache, key, true, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+    bool ok = false;
+    int fd = mkstemp(tmp);
+    if (fd >= 0) {
+        FILE *out = fdopen(fd, "wb");
+        if (out) {
+            ok = fwrite(values, bytes, TILE_PIXELS, out) == TILE_PIXELS;
+            ok = fclose(out) == 0 && ok;
+        } else {
+            close(fd);
+        }
+        ok = ok && rename(tmp, path) == 0;
+        if (!ok) {
+            unlink(tmp);
+        }
+    }
+    if (!ok && !atomic_exchange(&cache->disk_failed, true)) {
+        fprintf(stderr, "Warning: Failed to write tile '%s', not caching tiles on disk\n", path);
+    }
+}
+
+void pyramid_tile_view(Config *config, int z, long long x, long long y) {
+    double size = ldexp(PYRAMID_SPAN, -z);
+    config->width = config->height = PYRAMID_TILE;
+    config->ll_x = PYRAMID_LL_X + x * size;
+    config->ur_x = PYRAMID_LL_X + (x + 1) * size;
+    config->ur_y = PYRAMID_UR_Y - y * size;
+    config->ll_y = PYRAMID_UR_Y - (y + 1) * size;
+    config->ll_x_str = config->ll_y_str = config->ur_x_str = config->ur_y_str = NULL;
+}
+
+void tile_cache_get(TileCache *cache, RenderPool *pool, const Config *config, int z, long long x,
+                    long long y, void *out, KernelStats *stats) {
+    KernelStats counts = {0};
+    TileKey key = tile_key(config, z, x, y);
+    int bytes = config_pixel_bytes(config);
+
+    pthread_mutex_lock(&cache->lock);
+    TileEntry *e = cache_find(cache, &key);
+    if (e) {
+        memcpy(out, e->values, TILE_PIXELS * bytes);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (e) {
+        counts.tiles_memory = 1;
+    } else {
+        bool from_disk = cache->dir && disk_read(cache, &key, out, bytes);
+        if (from_disk) {
+            counts.tiles_disk = 1;
+        } else {
+            Config job = *config;
+            pyramid_tile_view(&job, z, x, y);
+            job.palette = PALETTE_NONE; // tiles hold values; views colour them
+            job.aa = 1;
+            job.stats = false;
+            render_pool_frame(pool, &job, out, (size_t)PYRAMID_TILE * bytes, &counts);
+            counts.tiles_rendered = 1;
+            if (cache->dir && !atomic_load(&cache->disk_failed)) {
+                disk_write(cache, &key, out, bytes);
+            }
+        }
+        pthread_mutex_lock(&cache->lock);
+        cache_insert(cache, &key, out, bytes);
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    if (stats) {
+        stats->periodic += counts.periodic;
+        stats->filled += counts.filled;
+        stats->rebases += counts.rebases;
+        stats->iterations += counts.iterations;
+        stats->orbit_len = counts.orbit_len ? counts.orbit_len : stats->orbit_len;
+        stats->tiles_memory += counts.tiles_memory;
+        stats->tiles_disk += counts.tiles_disk;
+        stats->tiles_rendered += counts.tiles_rendered;
+    }
+}
+
+// floor(a / PYRAMID_TILE), for negative a too
+static long long tile_of(long long a) {
+    return a >= 0 ? a / PYRAMID_TILE : -((-a + PYRAMID_TILE - 1) / PYRAMID_TILE);
+}
+
+/**
+ * @brief Maps n view samples start + i * step onto the level's pixel grid.
+ * @param start, step The view's samples, in grid pixels from the level origin.
+ * @param tile Receives the tile index of each sample.
+ * @param pixel Receives the pixel within that tile.
+ */
+static void grid_map(double start, double step, int n, long long *tile, int *pixel) {
+    for (int i = 0; i < n; ++i) {
+        long long g = (long long)floor(start + i * step + 0.5);
+        tile[i] = tile_of(g);
+        pixel[i] = (int)(g - tile[i] * PYRAMID_TILE);
+    }
+}
+
+// Copies the samples [i0, i1) of one view row from a tile row, inlined per width
+static inline __attribute__((always_inline))
+void sample_span(void *dest, const void *src, const int *pixel, int i0, int i1, int bytes) {
+    for (int i = i0; i < i1; ++i) {
+        store_iter(dest, i, load_iter(src, pixel[i], bytes), bytes);
+    }
+}
+
+static void sample_row(void *dest, const void *src, const int *pixel, int i0, int i1, int bytes) {
+    switch (bytes) {
+    case 1: sample_span(dest, src, pixel, i0, i1, 1); break;
+    case 2: sample_span(dest, src, pixel, i0, i1, 2); break;
+    default: sample_span(dest, src, pixel, i0, i1, 4); break;
+    }
+}
+
+void render_pyramid(TileCache *cache, RenderPool *pool, const Config *config, void *out,
+                    size_t stride, KernelStats *stats) {
+    double dx = (config->ur_x - config->ll_x) / config->width;
+    double dy = (config->ur_y - config->ll_y) / config->height;
+    double level = log2(PYRAMID_SPAN / (PYRAMID_TILE * fmin(dx, dy)));
+    int z = (int)ceil(level - 1e-9); // a view on the grid of level z picks z
+    z = z < 0 ? 0 : z > PYRAMID_MAX_LEVEL ? PYRAMID_MAX_LEVEL : z;
+    double grid = ldexp(PYRAMID_SPAN / PYRAMID_TILE, -z);
+
+    int bytes = config_pixel_bytes(config);
+    long long *col_tile = malloc(sizeof(long long) * config->width);
+    long long *row_tile = malloc(sizeof(long long) * config->height);
+    int *col_pixel = malloc(sizeof(int) * config->width);
+    int *row_pixel = malloc(sizeof(int) * config->height);
+    void *tile = malloc(TILE_PIXELS * bytes);
+    if (!col_tile || !row_tile || !col_pixel || !row_pixel || !tile) {
+        perror("Failed to allocate pyramid view");
+        exit(EXIT_FAILURE);
+    }
+    grid_map((config->ll_x - PYRAMID_LL_X) / grid, dx / grid, config->width, col_tile, col_pixel);
+    grid_map((PYRAMID_UR_Y - config->ur_y) / grid, dy / grid, config->height, row_tile, row_pixel);
+
+    // With a palette, each band of rows is sampled as values and then coloured into out
+    ColourMap *colours = NULL;
+    void *band = NULL;
+    size_t band_stride = (size_t)config->width * bytes;
+    if (config_rgb(config)) {
+        int band_rows = 0;
+        for (int j0 = 0, j1; j0 < config->height; j0 = j1) {
+            for (j1 = j0 + 1; j1 < config->height && row_tile[j1] == row_tile[j0]; ++j1) {}
+            band_rows = j1 - j0 > band_rows ? j1 - j0 : band_rows;
+        }
+        colours = colour_map_create(config->palette, config_value_max(config));
+        band = malloc(band_stride * band_rows);
+        if (!band) {
+            perror("Failed to allocate pyramid view");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int j0 = 0, j1; j0 < config->height; j0 = j1) {
+        for (j1 = j0 + 1; j1 < config->height && row_tile[j1] == row_tile[j0]; ++j1) {}
+        for (int i0 = 0, i1; i0 < config->width; i0 = i1) {
+            for (i1 = i0 + 1; i1 < config->width && col_tile[i1] == col_tile[i0]; ++i1) {}
+            tile_cache_get(cache, pool, config, z, col_tile[i0], row_tile[j0], tile, stats);
+            for (int j = j0; j < j1; ++j) {
+                void *dest = band ? (char *)band + (j - j0) * band_stride
+                             : (char *)out + j * stride;
+                sample_row(dest, (const char *)tile + (size_t)row_pixel[j] * PYRAMID_TILE * bytes,
+                           col_pixel, i0, i1, bytes);
+            }
+        }
+        for (int j = j0; stats && stats->histogram && j < j1; ++j) {
+            histogram_add(stats->histogram, band ? (char *)band + (j - j0) * band_stride
+                                                 : (char *)out + j * stride, config->width, bytes);
+        }
+        for (int j = j0; band && j < j1; ++j) {
+            colour_row(colours, (const char *)band + (j - j0) * band_stride, config->width, bytes,
+                       (uint8_t *)out + j * stride);
+        }
+    }
+    if (stats) {
+        stats->tile_level = z;
+    }
+
+    colour_map_free(colours);
+    free(band);
+    free(tile);
+    free(row_pixel);
+    free(col_pixel);
+    free(row_tile);
+    free(col_tile);
+}